@@ -0,0 +1,608 @@
+#include "BoardState.hpp"
+#include "GameOfLife.hpp"
+#include "StepKernel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Step kernel benchmark suite. Checks every kernel the CPU supports against the
+// reference implementation, then times each implementation over a matrix of board
+// sizes, starting patterns and thread counts. Results can be written as JSON and
+// compared against a previous run's file, failing on regressions.
+
+struct Measurement {
+    long long Generations{ 0 };
+    double Seconds{ 0 };
+};
+
+// Runs generations from the given board for at least minSeconds
+typedef std::function<Measurement(const BoardState& initial, double minSeconds)> RunFunction;
+
+struct Implementation {
+    std::string Name;
+    RunFunction Run;
+    // The reference is far too slow for the big boards
+    size_t MaxSize;
+};
+
+struct Pattern {
+    const char* Name;
+    std::function<BoardState(size_t size)> Generate;
+};
+
+struct Result {
+    std::string Name;
+    size_t Size{ 0 };
+    double NanosPerCell{ 0 };
+    double GenerationsPerSecond{ 0 };
+    double BytesPerSecond{ 0 };
+};
+
+struct Options {
+    std::vector<size_t> Sizes{ 100, 1000, 4000, 16000 };
+    std::vector<size_t> Threads{};
+    double MinSeconds{ 0.3 };
+    const char* JsonPath{ nullptr };
+    const char* ComparePath{ nullptr };
+    double Tolerance{ 0.10 };
+    Rule StepRule{};
+};
+
+static BoardState GenerateSoup(size_t w, size_t h, float density) {
+    BoardState result(w, h);
+    std::mt19937 rng(1234);
+    std::bernoulli_distribution alive(density);
+    for (size_t y = 0; y < h; y++) {
+        for (size_t x = 0; x < w; x++)
+            result.SetCellState(int(x), int(y), alive(rng));
+    }
+    return result;
+}
+
+// Gliders heading in all four diagonal directions, one per 512x512 area
+static BoardState GenerateGliders(size_t w, size_t h) {
+    static const int glider[5][2] = { { 1, 0 }, { 2, 1 }, { 0, 2 }, { 1, 2 }, { 2, 2 } };
+
+    BoardState result(w, h);
+    std::mt19937 rng(4321);
+    for (size_t y = 0; y + 3 <= h; y += 512) {
+        for (size_t x = 0; x + 3 <= w; x += 512) {
+            bool flipX = rng() % 2 == 0;
+            bool flipY = rng() % 2 == 0;
+            for (const auto& cell : glider) {
+                int cx = flipX ? 2 - cell[0] : cell[0];
+                int cy = flipY ? 2 - cell[1] : cell[1];
+                result.SetCellState(int(x) + cx, int(y) + cy, true);
+            }
+        }
+    }
+    return result;
+}
+
+// Steps random boards of awkward sizes with the given kernel and with the cell by cell
+// reference (built on BoardState::CountNeighbors), and compares them every generation.
+// Random edits are sprinkled in, so the tile skipping gets exercised too.
+static bool CrossCheck(KernelLevel level, const Rule& rule, int rounds) {
+    std::mt19937 rng(5678);
+    std::uniform_int_distribution<size_t> size(1, 700);
+    std::uniform_real_distribution<float> density(0.0f, 0.6f);
+
+    SetKernelLevel(level);
+    StepScratch scratch;
+    for (int round = 0; round < rounds; round++) {
+        size_t w = size(rng);
+        size_t h = size(rng);
+        BoardState boards[2] = { GenerateSoup(w, h, density(rng)), BoardState(w, h) };
+        boards[0].SetAgePlaneCount(rule.GetAgePlaneCount());
+        boards[1].SetAgePlaneCount(rule.GetAgePlaneCount());
+        BoardState reference[2] = { boards[0], boards[1] };
+        int front = 0;
+
+        for (int generation = 0; generation < 24; generation++) {
+            if (generation % 8 == 7) {
+                for (int edit = 0; edit < 16; edit++) {
+                    int x = int(rng() % w);
+                    int y = int(rng() % h);
+                    int state = int(rng() % rule.GetStateCount());
+                    boards[front].SetState(x, y, state);
+                    reference[front].SetState(x, y, state);
+                }
+            }
+
+            StepBoard(boards[front], boards[1 - front], scratch, rule);
+            StepBoardReference(reference[front], reference[1 - front], rule);
+            front = 1 - front;
+
+            for (size_t y = 0; y < h; y++) {
+                for (size_t x = 0; x < w; x++) {
+                    if (boards[front].GetState(int(x), int(y)) != reference[front].GetState(int(x), int(y))) {
+                        std::printf("%s kernel mismatch under %s on a %zux%zu board, generation %d, cell %zu,%zu\n",
+                            GetKernelLevelName(level), rule.ToString().c_str(), w, h, generation, x, y);
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Steps a soup on the sparse plane and on a torus wide enough that nothing reaches its edges,
+// which has to match the plane's window cell for cell. The soup is placed in the window's corner,
+// so the plane also grows into negative tile coordinates, which only its population covers.
+static bool CrossCheckPlane(KernelLevel level, const Rule& rule, int rounds) {
+    const int generations = 24;
+    const size_t margin = generations + 1;
+    std::mt19937 rng(4321);
+    std::uniform_int_distribution<size_t> size(1, 200);
+    std::uniform_real_distribution<float> density(0.0f, 0.6f);
+
+    SetKernelLevel(level);
+    WorkerPool pool;
+    pool.SetThreadCount(2);
+    for (int round = 0; round < rounds; round++) {
+        size_t w = size(rng);
+        size_t h = size(rng);
+        BoardState soup = GenerateSoup(w, h, density(rng));
+        soup.SetAgePlaneCount(rule.GetAgePlaneCount());
+        for (int edit = 0; edit < 64; edit++)
+            soup.SetState(int(rng() % w), int(rng() % h), int(rng() % rule.GetStateCount()));
+
+        BoardState reference[2] = { BoardState(w + 2 * margin, h + 2 * margin), BoardState(w + 2 * margin, h + 2 * margin) };
+        reference[0].SetAgePlaneCount(rule.GetAgePlaneCount());
+        reference[1].SetAgePlaneCount(rule.GetAgePlaneCount());
+        for (size_t y = 0; y < h; y++) {
+            for (size_t x = 0; x < w; x++)
+                reference[0].SetState(int(x + margin), int(y + margin), soup.GetState(int(x), int(y)));
+        }
+        int front = 0;
+
+        SparsePlane plane;
+        plane.SetRule(rule);
+        plane.Import(soup);
+        for (int generation = 0; generation < generations; generation++) {
+            StepBoardReference(reference[front], reference[1 - front], rule);
+            front = 1 - front;
+            plane.Step(pool);
+        }
+
+        BoardState window(w + margin, h + margin);
+        window.SetAgePlaneCount(rule.GetAgePlaneCount());
+        plane.Export(window);
+        bool isSame = plane.GetPopulation() == reference[front].CountPopulation();
+        for (size_t y = 0; y < window.GetHeight() && isSame; y++) {
+            for (size_t x = 0; x < window.GetWidth() && isSame; x++)
+                isSame = window.GetState(int(x), int(y)) == reference[front].GetState(int(x + margin), int(y + margin));
+        }
+        if (!isSame) {
+            std::printf("%s kernel mismatch on the sparse plane under %s, from a %zux%zu soup\n",
+                GetKernelLevelName(level), rule.ToString().c_str(), w, h);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Region operations on random boards with dying cells, against the same edits made cell by cell
+// through SetState. Tiles holding changed cells have to be flagged, and the padding bits of each
+// row have to stay clear, which the population counts catch.
+static bool CrossCheckRegions(int rounds) {
+    std::mt19937 rng(2468);
+    std::uniform_int_distribution<size_t> size(1, 300);
+
+    auto randomBoard = [&](size_t w, size_t h, int agePlanes) {
+        BoardState board = GenerateSoup(w, h, 0.4f);
+        board.SetAgePlaneCount(agePlanes);
+        int states = 2 + ((1 << agePlanes) - 1);
+        for (size_t edit = 0; edit < w * h / 4; edit++)
+            board.SetState(int(rng() % w), int(rng() % h), int(rng() % states));
+        return board;
+    };
+
+    auto isSame = [](const BoardState& board, const BoardState& reference, const BoardState& before) {
+        if (board.GetWidth() != reference.GetWidth() || board.GetHeight() != reference.GetHeight())
+            return false;
+        if (board.CountPopulation() != reference.CountPopulation())
+            return false;
+        for (size_t y = 0; y < board.GetHeight(); y++) {
+            for (size_t x = 0; x < board.GetWidth(); x++) {
+                int state = board.GetState(int(x), int(y));
+                if (state != reference.GetState(int(x), int(y)))
+                    return false;
+                if (state != before.GetState(int(x), int(y)) && !board.IsTileChanged(x / CellsPerWord, y / TileSize))
+                    return false;
+            }
+        }
+        return true;
+    };
+
+    const char* operations[] = { "fill", "invert", "copy", "paste (replace)", "paste (or)", "paste (xor)", "rotate", "mirror x", "mirror y" };
+    for (int round = 0; round < rounds; round++) {
+        size_t w = size(rng);
+        size_t h = size(rng);
+        int agePlanes = int(rng() % (MaxAgePlanes + 1));
+        BoardState before = randomBoard(w, h, agePlanes);
+        for (size_t tx = 0; tx < before.GetTileColumns(); tx++) {
+            for (size_t ty = 0; ty < before.GetTileRows(); ty++)
+                before.SetTileChanged(tx, ty, false);
+        }
+
+        // Regions start anywhere, even off the board, and can be bigger than it
+        int x = int(rng() % (3 * w)) - int(w);
+        int y = int(rng() % (3 * h)) - int(h);
+        size_t regionWidth = 1 + rng() % (w + 70);
+        size_t regionHeight = 1 + rng() % (h + 70);
+        auto wrap = [](int value, size_t size) { return int(((value % int(size)) + int(size)) % int(size)); };
+
+        for (int operation = 0; operation < int(sizeof(operations) / sizeof(operations[0])); operation++) {
+            BoardState board = before;
+            BoardState reference = before;
+            size_t spanWidth = std::min(regionWidth, w);
+            size_t spanHeight = std::min(regionHeight, h);
+            switch (operation) {
+            case 0: {
+                bool state = rng() % 2 == 0;
+                board.FillRegion(x, y, regionWidth, regionHeight, state);
+                for (size_t dy = 0; dy < spanHeight; dy++) {
+                    for (size_t dx = 0; dx < spanWidth; dx++)
+                        reference.SetState(wrap(x + int(dx), w), wrap(y + int(dy), h), state ? 1 : 0);
+                }
+                break;
+            }
+            case 1:
+                board.InvertRegion(x, y, regionWidth, regionHeight);
+                for (size_t dy = 0; dy < spanHeight; dy++) {
+                    for (size_t dx = 0; dx < spanWidth; dx++) {
+                        int cx = wrap(x + int(dx), w);
+                        int cy = wrap(y + int(dy), h);
+                        reference.SetState(cx, cy, reference.GetCellState(cx, cy) ? 0 : 1);
+                    }
+                }
+                break;
+            case 2:
+                board = before.CopyRegion(x, y, regionWidth, regionHeight);
+                reference = BoardState(spanWidth, spanHeight);
+                reference.SetAgePlaneCount(agePlanes);
+                for (size_t dy = 0; dy < spanHeight; dy++) {
+                    for (size_t dx = 0; dx < spanWidth; dx++)
+                        reference.SetState(int(dx), int(dy), before.GetState(wrap(x + int(dx), w), wrap(y + int(dy), h)));
+                }
+                break;
+            case 3:
+            case 4:
+            case 5: {
+                // Pasted boards may come from a rule with more or fewer dying states
+                BoardState block = randomBoard(regionWidth, regionHeight, int(rng() % (MaxAgePlanes + 1)));
+                PasteMode mode = PasteMode(operation - 3);
+                board.PasteRegion(block, x, y, mode);
+                for (size_t dy = 0; dy < spanHeight; dy++) {
+                    for (size_t dx = 0; dx < spanWidth; dx++) {
+                        int cx = wrap(x + int(dx), w);
+                        int cy = wrap(y + int(dy), h);
+                        int state = block.GetState(int(dx), int(dy));
+                        if (mode == PasteMode::Replace)
+                            reference.SetState(cx, cy, state);
+                        else if (state == 1)
+                            reference.SetState(cx, cy, mode == PasteMode::Or || !reference.GetCellState(cx, cy) ? 1 : 0);
+                    }
+                }
+                break;
+            }
+            case 6:
+                board = before.Rotated();
+                reference = BoardState(h, w);
+                reference.SetAgePlaneCount(agePlanes);
+                for (size_t cy = 0; cy < h; cy++) {
+                    for (size_t cx = 0; cx < w; cx++)
+                        reference.SetState(int(h - 1 - cy), int(cx), before.GetState(int(cx), int(cy)));
+                }
+                break;
+            case 7:
+            case 8:
+                if (operation == 7)
+                    board.MirrorX();
+                else
+                    board.MirrorY();
+                for (size_t cy = 0; cy < h; cy++) {
+                    for (size_t cx = 0; cx < w; cx++) {
+                        size_t sx = operation == 7 ? w - 1 - cx : cx;
+                        size_t sy = operation == 8 ? h - 1 - cy : cy;
+                        reference.SetState(int(cx), int(cy), before.GetState(int(sx), int(sy)));
+                    }
+                }
+                break;
+            }
+
+            // Boards of other sizes have nothing to compare their tile flags with
+            const BoardState& unchanged = board.GetWidth() == w && board.GetHeight() == h ? before : board;
+            if (!isSame(board, reference, unchanged)) {
+                std::printf("%s mismatch on a %zux%zu board with %d age planes, region %zux%zu at %d,%d\n",
+                    operations[operation], w, h, agePlanes, regionWidth, regionHeight, x, y);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static Measurement MeasureStep(const std::function<void(const BoardState&, BoardState&)>& step, const BoardState& initial, double minSeconds) {
+    BoardState boards[2] = { initial, initial };
+    int front = 0;
+
+    Measurement result;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        step(boards[front], boards[1 - front]);
+        front = 1 - front;
+        result.Generations++;
+        result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (result.Seconds < minSeconds);
+    return result;
+}
+
+static Measurement MeasureController(size_t threads, const Rule& rule, const BoardState& initial, double minSeconds) {
+    IterationController controller(initial.GetWidth(), initial.GetHeight());
+    controller.SetThreadCount(threads);
+    // Stepping is what's measured, so no rewinding history is recorded whatever the default
+    controller.SetTimelineBudget(0);
+    controller.SetRule(rule);
+    controller.GetMutBoard() = initial;
+
+    Measurement result;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        result.Generations += controller.DoIteration();
+        result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (result.Seconds < minSeconds);
+    return result;
+}
+
+static std::vector<size_t> ParseList(const char* text) {
+    std::vector<size_t> result;
+    std::istringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t value = std::strtoul(item.c_str(), nullptr, 10);
+        if (value > 0)
+            result.push_back(value);
+    }
+    return result;
+}
+
+static void PrintUsage() {
+    std::puts(
+        "usage: gol-bench [options]\n"
+        "  --sizes A,B,...      board sizes to run (default 100,1000,4000,16000)\n"
+        "  --threads A,B,...    IterationController thread counts (default 1 and all hardware threads)\n"
+        "  --min-seconds S      minimum time spent on each case (default 0.3)\n"
+        "  --json FILE          write the results as JSON\n"
+        "  --compare FILE       compare against a JSON file from an earlier run, failing on regressions\n"
+        "  --tolerance F        slowdown allowed before a case counts as a regression (default 0.10)\n"
+        "  --rule B/S           rule to time the kernels with (default B3/S23)"
+    );
+}
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (std::strcmp(name, "--help") == 0 || i + 1 >= argc)
+            return false;
+
+        const char* value = argv[++i];
+        if (std::strcmp(name, "--sizes") == 0)
+            options.Sizes = ParseList(value);
+        else if (std::strcmp(name, "--threads") == 0)
+            options.Threads = ParseList(value);
+        else if (std::strcmp(name, "--min-seconds") == 0)
+            options.MinSeconds = std::strtod(value, nullptr);
+        else if (std::strcmp(name, "--json") == 0)
+            options.JsonPath = value;
+        else if (std::strcmp(name, "--compare") == 0)
+            options.ComparePath = value;
+        else if (std::strcmp(name, "--tolerance") == 0)
+            options.Tolerance = std::strtod(value, nullptr);
+        else if (std::strcmp(name, "--rule") == 0) {
+            std::string error;
+            if (!Rule::Parse(value, options.StepRule, error)) {
+                std::printf("%s\n", error.c_str());
+                return false;
+            }
+        } else
+            return false;
+    }
+
+    if (options.Threads.empty()) {
+        options.Threads.push_back(1);
+        size_t hardware = std::thread::hardware_concurrency();
+        if (hardware > 1)
+            options.Threads.push_back(hardware);
+    }
+    return !options.Sizes.empty();
+}
+
+static void WriteJson(std::ostream& out, const std::vector<Result>& results) {
+    out << "{\n  \"kernel\": \"" << GetKernelLevelName(GetSupportedKernelLevel()) << "\",\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& result = results[i];
+        char line[512];
+        std::snprintf(line, sizeof(line),
+            "    { \"name\": \"%s\", \"size\": %zu, \"ns_per_cell\": %.6g, \"generations_per_second\": %.6g, \"bytes_per_second\": %.6g }%s\n",
+            result.Name.c_str(), result.Size, result.NanosPerCell, result.GenerationsPerSecond, result.BytesPerSecond,
+            i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+}
+
+// Reads the ns/cell of every case from a file written by WriteJson. Not a general JSON
+// parser, it only looks for the name and ns_per_cell keys of each result.
+static bool ReadBaseline(const char* path, std::map<std::string, double>& baseline) {
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t name = line.find("\"name\": \"");
+        size_t nanos = line.find("\"ns_per_cell\": ");
+        if (name == std::string::npos || nanos == std::string::npos)
+            continue;
+
+        name += std::strlen("\"name\": \"");
+        size_t nameEnd = line.find('"', name);
+        if (nameEnd == std::string::npos)
+            continue;
+        baseline[line.substr(name, nameEnd - name)] = std::strtod(line.c_str() + nanos + std::strlen("\"ns_per_cell\": "), nullptr);
+    }
+    return true;
+}
+
+// Returns the number of regressions
+static int Compare(const std::vector<Result>& results, const std::map<std::string, double>& baseline, double tolerance) {
+    int regressions = 0;
+    std::printf("\n%-32s %14s %14s %9s\n", "case", "baseline ns", "current ns", "change");
+    for (const Result& result : results) {
+        auto found = baseline.find(result.Name);
+        if (found == baseline.end()) {
+            std::printf("%-32s %14s %14.4g %9s\n", result.Name.c_str(), "-", result.NanosPerCell, "new");
+            continue;
+        }
+
+        double change = result.NanosPerCell / found->second - 1.0;
+        bool regressed = change > tolerance;
+        regressions += regressed ? 1 : 0;
+        std::printf("%-32s %14.4g %14.4g %+8.1f%%%s\n", result.Name.c_str(), found->second, result.NanosPerCell,
+            change * 100.0, regressed ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::vector<KernelLevel> levels;
+    for (int level = 0; level <= int(GetSupportedKernelLevel()); level++)
+        levels.push_back(KernelLevel(level));
+
+    // Conway's rule and each of the rules with kernels of their own, then some that go through
+    // the table, including B0 ones which flip the whole board every generation, and Generations
+    // rules using 1 to 3 age planes
+    const char* checkedRules[] = { "B3/S23", "B36/S23", "B3678/S34678", "B2/S", "B3/S12345", "B1357/S1357", "B0/S8", "B0123478/S01234678",
+        "B2/S/C3", "B2/S345/C4", "B23/S23/C8", "B3/S23/C9", "B012/S1/C6" };
+    for (KernelLevel level : levels) {
+        for (const char* notation : checkedRules) {
+            Rule rule;
+            std::string error;
+            Rule::Parse(notation, rule, error);
+            if (!CrossCheck(level, rule, rule == Rule() ? 40 : 8))
+                return 1;
+            if (SparsePlane::SupportsRule(rule) && !CrossCheckPlane(level, rule, 4))
+                return 1;
+        }
+    }
+    std::printf("all kernels match the reference, using %s\n", GetKernelLevelName(GetSupportedKernelLevel()));
+    if (!CrossCheckRegions(200))
+        return 1;
+    std::printf("region operations match the reference\n\n");
+
+    // Cases run under other rules are named after them, so they aren't compared against Conway's
+    Rule rule = options.StepRule;
+    std::string suffix = rule == Rule() ? "" : " " + rule.ToString();
+
+    StepScratch scratch;
+    std::vector<Implementation> implementations;
+    implementations.push_back({ "reference" + suffix, [rule](const BoardState& initial, double minSeconds) {
+        return MeasureStep([rule](const BoardState& src, BoardState& dst) { StepBoardReference(src, dst, rule); }, initial, minSeconds);
+    }, 1000 });
+    for (KernelLevel level : levels) {
+        implementations.push_back({ GetKernelLevelName(level) + suffix, [&scratch, level, rule](const BoardState& initial, double minSeconds) {
+            SetKernelLevel(level);
+            return MeasureStep([&scratch, rule](const BoardState& src, BoardState& dst) { StepBoard(src, dst, scratch, rule); }, initial, minSeconds);
+        }, size_t(-1) });
+    }
+    for (size_t threads : options.Threads) {
+        implementations.push_back({ "controller-" + std::to_string(threads) + "t" + suffix, [threads, rule](const BoardState& initial, double minSeconds) {
+            SetKernelLevel(GetSupportedKernelLevel());
+            return MeasureController(threads, rule, initial, minSeconds);
+        }, size_t(-1) });
+    }
+
+    const Pattern patterns[] = {
+        { "soup", [](size_t size) { return GenerateSoup(size, size, 0.35f); } },
+        { "gliders", [](size_t size) { return GenerateGliders(size, size); } },
+        { "dead", [](size_t size) { return BoardState(size, size); } },
+    };
+
+    std::vector<Result> results;
+    std::printf("%-32s %12s %14s %12s\n", "case", "ns/cell", "generations/s", "GB/s");
+    for (size_t size : options.Sizes) {
+        for (const Pattern& pattern : patterns) {
+            BoardState initial = pattern.Generate(size);
+            initial.SetAgePlaneCount(rule.GetAgePlaneCount());
+            for (const Implementation& implementation : implementations) {
+                if (size > implementation.MaxSize)
+                    continue;
+
+                Measurement measurement = implementation.Run(initial, options.MinSeconds);
+                double cells = double(size) * double(size) * double(measurement.Generations);
+
+                // Nominal traffic: the source board is read and the destination written once per generation
+                double boardBytes = double(initial.GetStride()) * double(size) * sizeof(CellWord);
+
+                Result result;
+                result.Name = implementation.Name + "/" + pattern.Name + "/" + std::to_string(size);
+                result.Size = size;
+                result.NanosPerCell = measurement.Seconds * 1e9 / cells;
+                result.GenerationsPerSecond = double(measurement.Generations) / measurement.Seconds;
+                result.BytesPerSecond = 2.0 * boardBytes * result.GenerationsPerSecond;
+                results.push_back(result);
+
+                std::printf("%-32s %12.4g %14.4g %12.3g\n", result.Name.c_str(), result.NanosPerCell,
+                    result.GenerationsPerSecond, result.BytesPerSecond / 1e9);
+                std::fflush(stdout);
+            }
+        }
+    }
+
+    if (options.JsonPath) {
+        std::ofstream file(options.JsonPath);
+        WriteJson(file, results);
+        if (!file) {
+            std::fprintf(stderr, "can't write %s\n", options.JsonPath);
+            return 1;
+        }
+    }
+
+    if (options.ComparePath) {
+        std::map<std::string, double> baseline;
+        if (!ReadBaseline(options.ComparePath, baseline)) {
+            std::fprintf(stderr, "can't read %s\n", options.ComparePath);
+            return 1;
+        }
+
+        int regressions = Compare(results, baseline, options.Tolerance);
+        if (regressions > 0) {
+            std::printf("\n%d case(s) regressed by more than %.0f%%\n", regressions, options.Tolerance * 100.0);
+            return 2;
+        }
+        std::printf("\nno regressions\n");
+    }
+
+    return 0;
+}
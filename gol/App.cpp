@@ -1,5 +1,6 @@
 #include "App.hpp"
 #include "Common.hpp"
+#include "PatternFile.hpp"
 
 #include <SDL.h>
 #include "imgui.h"
@@ -10,6 +11,9 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
+#include <fstream>
+#include <memory>
+#include <chrono>
 #include <cmath>
 
 class FramerateController {
@@ -19,13 +23,13 @@ public:
     }
 
     void BeginFrame() {
+        // The delta covers the whole previous frame, including the sleep at its end
+        m_Delta = float(m_FrameTimeCounter.GetPassedSeconds());
         m_FrameTimeCounter.Start();
     }
 
     void EndFrame() {
         auto frameMillis = m_FrameTimeCounter.GetPassedMillis();
-
-        m_Delta = 1.0f / float(frameMillis);
         m_FPSCounter.Update();
 
         int sleep = GetMaxSleepMillis() - frameMillis;
@@ -50,7 +54,7 @@ private:
     Timer m_FrameTimeCounter{};
     RateCounter m_FPSCounter{};
 
-    float m_Delta{ 1 };
+    float m_Delta{ 0 };
 };
 
 void App::Run() {
@@ -94,27 +98,92 @@ void App::Run() {
         return (world * m_Renderer.CameraZoom) - glm::vec2(m_Renderer.CameraX, m_Renderer.CameraY);
     };
 
+    // Size of the board as last drawn. The mouse is mapped onto what's on screen, and the
+    // simulation thread's own boards can't be looked at while it runs.
+    glm::vec2 boardSize(m_IterationController.GetBoardWidth(), m_IterationController.GetBoardHeight());
+
     auto isOnBoard = [&](glm::vec2 world) -> bool {
-        if (world.x < 0 || world.y < 0)
+        // With wrap around on, the copies drawn next to the board count as well
+        float copies = renderSettings.WrapAround ? 1.0f : 0.0f;
+        float width = boardSize.x * renderSettings.CellSize;
+        float height = boardSize.y * renderSettings.CellSize;
+        if (world.x < -copies * width || world.y < -copies * height)
             return false;
-        if (world.x >= (m_IterationController.GetBoardWidth() * renderSettings.CellSize))
+        if (world.x >= (1 + copies) * width)
             return false;
-        if (world.y >= (m_IterationController.GetBoardHeight() * renderSettings.CellSize))
+        if (world.y >= (1 + copies) * height)
             return false;
         return true;
     };
 
+    auto worldToCell = [&](glm::vec2 world) -> glm::vec2 {
+        glm::vec2 cell = glm::floor(world / renderSettings.CellSize);
+        if (renderSettings.WrapAround)
+            cell = glm::mod(cell, boardSize);
+        return cell;
+    };
+
     auto swapY = [&](auto y) {
         return m_WindowHeight - y;
     };
 
+    // Strokes aren't wrapped into the board here, the board wraps them as they're drawn.
+    // Their ends can be off the board though, so they're first clipped to the area
+    // isOnBoard accepts (Liang-Barsky), and only the part on it is painted.
+    auto paintStroke = [&](glm::vec2 fromWorld, glm::vec2 toWorld, bool state) {
+        if (!m_IterationController.IsPaused())
+            return;
+
+        float copies = renderSettings.WrapAround ? 1.0f : 0.0f;
+        glm::vec2 areaMin = -copies * boardSize;
+        glm::vec2 areaMax = (1 + copies) * boardSize;
+        glm::vec2 delta = toWorld - fromWorld;
+        float enter = 0.0f;
+        float leave = 1.0f;
+        for (int axis = 0; axis < 2; axis++) {
+            float low = areaMin[axis] * renderSettings.CellSize;
+            float high = areaMax[axis] * renderSettings.CellSize;
+            if (delta[axis] == 0.0f) {
+                if (fromWorld[axis] < low || fromWorld[axis] >= high)
+                    return;
+                continue;
+            }
+            float t1 = (low - fromWorld[axis]) / delta[axis];
+            float t2 = (high - fromWorld[axis]) / delta[axis];
+            enter = std::max(enter, std::min(t1, t2));
+            leave = std::min(leave, std::max(t1, t2));
+        }
+        if (enter > leave)
+            return;
+
+        // A clipped end can land exactly on the far edge, which is just past the last cell
+        auto toCell = [&](glm::vec2 world) -> glm::ivec2 {
+            glm::vec2 cell = glm::floor(world / renderSettings.CellSize);
+            return glm::clamp(cell, areaMin, areaMax - 1.0f);
+        };
+        glm::ivec2 from = toCell(fromWorld + delta * enter);
+        glm::ivec2 to = toCell(fromWorld + delta * leave);
+        m_PendingStrokes.push_back({ from, to, state });
+    };
+
+    // Spans the selection from its anchor to the given cell
+    auto selectTo = [&](glm::vec2 world) {
+        if (!isOnBoard(world))
+            return;
+        glm::ivec2 cell = worldToCell(world);
+        m_Selection[0] = std::min(cell.x, m_SelectionAnchor.x);
+        m_Selection[1] = std::min(cell.y, m_SelectionAnchor.y);
+        m_Selection[2] = std::abs(cell.x - m_SelectionAnchor.x) + 1;
+        m_Selection[3] = std::abs(cell.y - m_SelectionAnchor.y) + 1;
+    };
+
     bool isMovingCamera = false;
     glm::vec2 localMoveHoldPoint;
     glm::vec2 worldMoveHoldPoint;
-    glm::vec2 lastSelectedCell(0);
 
     framerateController.Start();
     m_IterationController.Pause();
+    m_IterationController.StartThread();
 
     m_IsRunning = true;
     while (m_IsRunning) {
@@ -139,7 +208,7 @@ void App::Run() {
                         auto local = glm::vec2(evt.button.x, swapY(evt.button.y));
                         auto world = glm::vec2(m_Renderer.CameraX, m_Renderer.CameraY);
                         auto zoom1 = m_Renderer.CameraZoom;
-                        m_Renderer.CameraZoom += 0.1f * delta * evt.wheel.y;
+                        m_Renderer.CameraZoom += 0.05f * evt.wheel.y;
                         auto zoom2 = m_Renderer.CameraZoom;
                         auto newWorld = (((local + world) / zoom1) * zoom2) - local / zoom1 * zoom2;
                         m_Renderer.CameraX = newWorld.x;
@@ -158,6 +227,17 @@ void App::Run() {
                                 isMovingCamera = false;
                             }
                         }
+                        if ((evt.button.button == SDL_BUTTON_LEFT || evt.button.button == SDL_BUTTON_RIGHT) && evt.button.state == SDL_PRESSED) {
+                            auto world = localToWorld(glm::vec2(evt.button.x, swapY(evt.button.y)));
+                            if (m_IsSelectionShown && m_IsSelectingWithMouse) {
+                                if (evt.button.button == SDL_BUTTON_LEFT && isOnBoard(world)) {
+                                    m_SelectionAnchor = worldToCell(world);
+                                    selectTo(world);
+                                }
+                            } else {
+                                paintStroke(world, world, evt.button.button == SDL_BUTTON_LEFT);
+                            }
+                        }
                         break;
                     
                     case SDL_MOUSEMOTION:
@@ -167,9 +247,18 @@ void App::Run() {
                             m_Renderer.CameraX = newPosition.x;
                             m_Renderer.CameraY = newPosition.y;
                         }
+                        // Every motion event adds a stroke, so fast strokes don't get cut short between frames
+                        if (m_IsSelectionShown && m_IsSelectingWithMouse) {
+                            if (evt.motion.state & SDL_BUTTON_LMASK)
+                                selectTo(localToWorld(glm::vec2(evt.motion.x, swapY(evt.motion.y))));
+                        } else if (evt.motion.state & (SDL_BUTTON_LMASK | SDL_BUTTON_RMASK)) {
+                            auto fromWorld = localToWorld(glm::vec2(evt.motion.x - evt.motion.xrel, swapY(evt.motion.y - evt.motion.yrel)));
+                            auto toWorld = localToWorld(glm::vec2(evt.motion.x, swapY(evt.motion.y)));
+                            paintStroke(fromWorld, toWorld, evt.motion.state & SDL_BUTTON_LMASK);
+                        }
                         auto mouseWorld = localToWorld(glm::vec2(evt.motion.x, swapY(evt.motion.y)));
                         renderSettings.MarkSelectedCell = isOnBoard(mouseWorld);
-                        renderSettings.SelectedCell = glm::floor(mouseWorld / renderSettings.CellSize);
+                        renderSettings.SelectedCell = worldToCell(mouseWorld);
 
 
                         
@@ -190,29 +279,29 @@ void App::Run() {
 
         // Get mouse position
         int mouseX, mouseY;
-        auto mouseState = SDL_GetMouseState(&mouseX, &mouseY);
+        SDL_GetMouseState(&mouseX, &mouseY);
         mouseY = swapY(mouseY);
         auto mouseLocal = glm::vec2(mouseX, mouseY);
         auto mouseWorld = localToWorld(mouseLocal);
 
-        // Mouse drawing
-        if (m_IterationController.IsPaused() && (mouseState & (SDL_BUTTON_LMASK | SDL_BUTTON_RMASK))) {
-            bool target = mouseState & SDL_BUTTON_LMASK;
-            m_IterationController.GetMutRenderBoard().SetCellLine(
-                lastSelectedCell.x, lastSelectedCell.y,
-                renderSettings.SelectedCell.x, renderSettings.SelectedCell.y,
-                target
-            );
-
-            //std::printf("(%d, %d) has %d neigbhors\n", (int)renderSettings.SelectedCell.x, (int)renderSettings.SelectedCell.y, m_IterationController.GetMutRenderBoard().CountNeighbors(renderSettings.SelectedCell.x, renderSettings.SelectedCell.y));
+        // Mouse drawing, all of the frame's strokes are applied together before the next generation
+        if (!m_PendingStrokes.empty()) {
+            int radius = m_BrushRadius;
+            m_IterationController.SubmitEdit([strokes = std::move(m_PendingStrokes), radius](BoardState& board) {
+                for (const BrushStroke& stroke : strokes)
+                    board.SetCellLine(stroke.From.x, stroke.From.y, stroke.To.x, stroke.To.y, stroke.State, radius);
+            });
+            m_PendingStrokes.clear();
         }
 
         // Render the board
         if (m_Renderer.CameraZoom < 0.001f)
             m_Renderer.CameraZoom = 0.001f;
 
-        m_IterationController.Process(delta);
-        m_Renderer.Render(m_IterationController.GetRenderBoard(), float(m_WindowWidth), float(m_WindowHeight), renderSettings);
+        renderSettings.StateCount = m_IterationController.GetRule().GetStateCount();
+        const BoardSnapshot& snapshot = m_IterationController.AcquireRenderSnapshot();
+        boardSize = glm::vec2(snapshot.Board.GetWidth(), snapshot.Board.GetHeight());
+        m_Renderer.Render(snapshot, float(m_WindowWidth), float(m_WindowHeight), renderSettings);
 
         // Render ImGui
         ImGui_ImplOpenGL3_NewFrame();
@@ -228,24 +317,26 @@ void App::Run() {
         ImGui::Text("Mouse world position: (%f, %f)", mouseWorld.x, mouseWorld.y);
 
         if (ImGui::Button("Clear")) {
-            m_IterationController.GetMutRenderBoard().Clear();
+            m_IterationController.SubmitEdit([](BoardState& board) { board.Clear(); });
         }
+        ImGui::SliderInt("Brush radius", &m_BrushRadius, 0, 32);
+        ImGui::TextDisabled("While paused, the left button paints cells and the right one erases them");
 
         if (ImGui::CollapsingHeader("Camera control")) {
             ImGui::Text("Camera position: (%f, %f)", m_Renderer.CameraX, m_Renderer.CameraY);
             ImGui::Text("Camera zoom: %.4fx", m_Renderer.CameraZoom);
 
-            if (ImGui::Button("+") || (ImGui::IsItemActive() && ImGui::IsItemHovered())) m_Renderer.CameraZoom += 0.1f * delta;
+            if (ImGui::Button("+") || (ImGui::IsItemActive() && ImGui::IsItemHovered())) m_Renderer.CameraZoom += 1.0f * delta;
             ImGui::SameLine();
-            if (ImGui::Button("-") || (ImGui::IsItemActive() && ImGui::IsItemHovered())) m_Renderer.CameraZoom -= 0.1f * delta;
+            if (ImGui::Button("-") || (ImGui::IsItemActive() && ImGui::IsItemHovered())) m_Renderer.CameraZoom -= 1.0f * delta;
             ImGui::SameLine(60);
-            if (ImGui::Button("<") || (ImGui::IsItemActive() && ImGui::IsItemHovered())) m_Renderer.CameraX -= 25.0f * delta;
+            if (ImGui::Button("<") || (ImGui::IsItemActive() && ImGui::IsItemHovered())) m_Renderer.CameraX -= 500.0f * delta;
             ImGui::SameLine();
-            if (ImGui::Button(">") || (ImGui::IsItemActive() && ImGui::IsItemHovered())) m_Renderer.CameraX += 25.0f * delta;
+            if (ImGui::Button(">") || (ImGui::IsItemActive() && ImGui::IsItemHovered())) m_Renderer.CameraX += 500.0f * delta;
             ImGui::SameLine();
-            if (ImGui::Button("^") || (ImGui::IsItemActive() && ImGui::IsItemHovered())) m_Renderer.CameraY += 25.0f * delta;
+            if (ImGui::Button("^") || (ImGui::IsItemActive() && ImGui::IsItemHovered())) m_Renderer.CameraY += 500.0f * delta;
             ImGui::SameLine();
-            if (ImGui::Button("v") || (ImGui::IsItemActive() && ImGui::IsItemHovered())) m_Renderer.CameraY -= 25.0f * delta;
+            if (ImGui::Button("v") || (ImGui::IsItemActive() && ImGui::IsItemHovered())) m_Renderer.CameraY -= 500.0f * delta;
 
             if (ImGui::Button("Reset camera position")) {
                 m_Renderer.CameraX = 0;
@@ -258,9 +349,44 @@ void App::Run() {
         ImGui::Spacing();
         ImGui::Spacing();
 
+        RenderPatternImgui();
+        RenderCheckpointImgui();
+        RenderSelectionImgui();
+
+        // The selection is outlined behind the windows while its panel is open
+        if (m_IsSelectionShown) {
+            glm::vec2 low = worldToLocal(glm::vec2(m_Selection[0], m_Selection[1]) * renderSettings.CellSize);
+            glm::vec2 high = worldToLocal(glm::vec2(m_Selection[0] + m_Selection[2], m_Selection[1] + m_Selection[3]) * renderSettings.CellSize);
+            ImGui::GetBackgroundDrawList()->AddRect(ImVec2(low.x, float(swapY(high.y))), ImVec2(high.x, float(swapY(low.y))),
+                IM_COL32(255, 200, 0, 255));
+        }
+
         if (ImGui::CollapsingHeader("Gradient options")) {
             ImGui::ColorEdit3("Left", glm::value_ptr(renderSettings.GradientLeft));
             ImGui::ColorEdit3("Right", glm::value_ptr(renderSettings.GradientRight));
+            if (renderSettings.StateCount > 2)
+                ImGui::TextDisabled("Generations rule: live cells take the left color, the oldest dying ones the right");
+        }
+        ImGui::Spacing();
+        ImGui::Spacing();
+
+        if (ImGui::CollapsingHeader("Renderer")) {
+            if (m_Renderer.IsTextureRendererSupported())
+                ImGui::Checkbox("Draw the board from a texture", &m_Renderer.UseTextureRenderer);
+            else
+                ImGui::Text("Textured drawing needs OpenGL 3.0, using immediate mode");
+            ImGui::Checkbox("Wrap around the edges", &renderSettings.WrapAround);
+            ImGui::Checkbox("Shade blocks by population when zoomed out", &m_Renderer.UseDensityLevels);
+            ImGui::Text("%.2f ms spent rendering the board", m_Renderer.GetLastRenderMillis());
+            ImGui::Text("%.1f KiB uploaded to the GPU last frame", m_Renderer.GetLastUploadBytes() / 1024.0);
+
+            size_t visited = m_Renderer.GetLastVisitedCells();
+            size_t total = m_Renderer.GetLastTotalCells();
+            int blockSize = m_Renderer.GetLastBlockSize();
+            if (blockSize > 1)
+                ImGui::Text("%zu blocks of %dx%d cells visited, out of %zu cells", visited, blockSize, blockSize, total);
+            else
+                ImGui::Text("%zu of %zu cells visited (%.1f%%)", visited, total, total ? 100.0 * visited / total : 0.0);
         }
         ImGui::Spacing();
         ImGui::Spacing();
@@ -275,9 +401,9 @@ void App::Run() {
         SDL_GL_SwapWindow(m_Window);
 
         framerateController.EndFrame();
-        lastSelectedCell = renderSettings.SelectedCell;
     }
 
+    m_IterationController.StopThread();
     m_Renderer.Deinit();
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -288,6 +414,168 @@ void App::Run() {
     SDL_Quit();
 }
 
+void App::RenderPatternImgui() {
+    if (!ImGui::CollapsingHeader("Pattern files"))
+        return;
+
+    ImGui::InputText("File", m_PatternPath, sizeof(m_PatternPath));
+    ImGui::InputInt2("Offset", m_PatternOffset);
+    ImGui::Checkbox("Clear the board before loading", &m_ClearBeforeLoad);
+    ImGui::TextDisabled("The format follows the extension: .rle, .cells or .lif");
+
+    if (ImGui::Button("Load")) {
+        std::string path = m_PatternPath;
+        size_t x = size_t(std::max(0, m_PatternOffset[0]));
+        size_t y = size_t(std::max(0, m_PatternOffset[1]));
+        bool clear = m_ClearBeforeLoad;
+        m_IterationController.SubmitEdit([this, path, x, y, clear](BoardState& board) {
+            std::string message;
+            std::ifstream file(path, std::ios::binary);
+            if (!file) {
+                message = "Can't open " + path;
+            } else {
+                if (clear)
+                    board.Clear();
+
+                PatternInfo info;
+                std::string error;
+                auto start = std::chrono::steady_clock::now();
+                if (ReadPattern(file, GetPatternFormat(path), board, x, y, info, error)) {
+                    double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                    message = "Loaded a " + std::to_string(info.Width) + "x" + std::to_string(info.Height)
+                        + " pattern in " + std::to_string(int(millis)) + " ms";
+
+                    // Patterns without a rule are taken to be for whatever rule is running
+                    Rule rule;
+                    if (!info.Rule.empty()) {
+                        if (Rule::Parse(info.Rule, rule, error))
+                            m_IterationController.SetRule(rule);
+                        else
+                            message += ", but kept the current rule: " + error;
+                    }
+                } else {
+                    message = "Error: " + error;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(m_PatternMessageMutex);
+            m_PatternMessage = message;
+        });
+    }
+
+    ImGui::SameLine();
+    if (ImGui::Button("Save")) {
+        std::string path = m_PatternPath;
+        std::ofstream file(path, std::ios::binary);
+        WritePattern(file, GetPatternFormat(path), m_IterationController.AcquireRenderBoard(), path,
+            m_IterationController.GetRule());
+
+        std::lock_guard<std::mutex> lock(m_PatternMessageMutex);
+        m_PatternMessage = file ? "Saved " + path : "Can't write " + path;
+    }
+
+    std::lock_guard<std::mutex> lock(m_PatternMessageMutex);
+    if (!m_PatternMessage.empty())
+        ImGui::TextWrapped("%s", m_PatternMessage.c_str());
+}
+
+void App::RenderCheckpointImgui() {
+    if (!ImGui::CollapsingHeader("Checkpoints"))
+        return;
+
+    ImGui::InputText("Checkpoint file", m_CheckpointPath, sizeof(m_CheckpointPath));
+
+    // Saves copy the latest snapshot and write it out in the background
+    if (ImGui::Button("Save checkpoint")) {
+        const BoardState& board = m_IterationController.AcquireRenderBoard();
+        m_CheckpointSaver.Start(m_CheckpointPath, Checkpoint{ board, m_IterationController.GetRenderGeneration(),
+            m_IterationController.GetRule().ToString() });
+        m_CheckpointMessage.clear();
+    }
+
+    ImGui::SameLine();
+    if (ImGui::Button("Load checkpoint")) {
+        auto checkpoint = std::make_shared<Checkpoint>();
+        std::string error;
+        Rule rule;
+        if (LoadCheckpoint(m_CheckpointPath, *checkpoint, error) && Rule::Parse(checkpoint->Rule, rule, error)) {
+            m_CheckpointMessage = "Loaded generation " + std::to_string(checkpoint->Generation);
+            m_IterationController.SubmitEdit([this, checkpoint, rule](BoardState& board) {
+                board = std::move(checkpoint->Board);
+                m_IterationController.SetIterationCounter(checkpoint->Generation);
+                m_IterationController.SetRule(rule);
+            });
+        } else {
+            m_CheckpointMessage = "Error: " + error;
+        }
+    }
+
+    if (m_CheckpointSaver.IsBusy())
+        ImGui::Text("Saving...");
+    else if (m_CheckpointMessage.empty())
+        ImGui::TextWrapped("%s", m_CheckpointSaver.GetStatus().c_str());
+    else
+        ImGui::TextWrapped("%s", m_CheckpointMessage.c_str());
+}
+
+void App::RenderSelectionImgui() {
+    m_IsSelectionShown = ImGui::CollapsingHeader("Selection");
+    if (!m_IsSelectionShown)
+        return;
+
+    ImGui::InputInt2("Corner", m_Selection);
+    ImGui::InputInt2("Size", m_Selection + 2);
+    m_Selection[2] = std::max(1, m_Selection[2]);
+    m_Selection[3] = std::max(1, m_Selection[3]);
+    ImGui::Checkbox("Select by dragging on the board instead of painting", &m_IsSelectingWithMouse);
+
+    // Regions wrap around the board like everything else, so the selection needs no clamping
+    int x = m_Selection[0];
+    int y = m_Selection[1];
+    size_t w = size_t(m_Selection[2]);
+    size_t h = size_t(m_Selection[3]);
+    if (ImGui::Button("Fill"))
+        m_IterationController.SubmitEdit([=](BoardState& board) { board.FillRegion(x, y, w, h, true); });
+    ImGui::SameLine();
+    if (ImGui::Button("Erase"))
+        m_IterationController.SubmitEdit([=](BoardState& board) { board.FillRegion(x, y, w, h, false); });
+    ImGui::SameLine();
+    if (ImGui::Button("Invert"))
+        m_IterationController.SubmitEdit([=](BoardState& board) { board.InvertRegion(x, y, w, h); });
+    ImGui::SameLine();
+    if (ImGui::Button("Copy"))
+        m_Clipboard = std::make_shared<const BoardState>(m_IterationController.AcquireRenderBoard().CopyRegion(x, y, w, h));
+
+    if (!m_Clipboard) {
+        ImGui::TextDisabled("Nothing copied yet");
+        return;
+    }
+
+    ImGui::Text("Clipboard: %zux%zu cells", m_Clipboard->GetWidth(), m_Clipboard->GetHeight());
+    const char* modeNames[] = { "Replace", "Or", "Xor" };
+    ImGui::Combo("Paste mode", &m_PasteMode, modeNames, IM_ARRAYSIZE(modeNames));
+    if (ImGui::Button("Paste at the corner")) {
+        std::shared_ptr<const BoardState> clipboard = m_Clipboard;
+        PasteMode mode = PasteMode(m_PasteMode);
+        m_IterationController.SubmitEdit([clipboard, x, y, mode](BoardState& board) { board.PasteRegion(*clipboard, x, y, mode); });
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Rotate"))
+        m_Clipboard = std::make_shared<const BoardState>(m_Clipboard->Rotated());
+    ImGui::SameLine();
+    if (ImGui::Button("Mirror left to right")) {
+        auto mirrored = std::make_shared<BoardState>(*m_Clipboard);
+        mirrored->MirrorX();
+        m_Clipboard = std::move(mirrored);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Mirror top to bottom")) {
+        auto mirrored = std::make_shared<BoardState>(*m_Clipboard);
+        mirrored->MirrorY();
+        m_Clipboard = std::move(mirrored);
+    }
+}
+
 int main() {
     App().Run();
     return 0;
@@ -2,9 +2,15 @@
 
 #define SDL_MAIN_HANDLED
 #include <SDL.h>
+#include "Checkpoint.hpp"
 #include "GameOfLife.hpp"
 #include "Renderer.hpp"
 
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
 class Renderer;
 
 class App {
@@ -23,6 +29,18 @@ public:
     int GetWindowHeight() const { return m_WindowHeight; }
 
 private:
+    void RenderPatternImgui();
+    void RenderCheckpointImgui();
+    void RenderSelectionImgui();
+
+    // Cells are in board coordinates, but may lie off the board, by a board's width or height at
+    // most, when painting across the wrapped around copies
+    struct BrushStroke {
+        glm::ivec2 From;
+        glm::ivec2 To;
+        bool State;
+    };
+
     bool m_IsRunning{ false };
     
     IterationController m_IterationController;
@@ -32,4 +50,32 @@ private:
     SDL_GLContext m_Context{};
     int m_WindowWidth{};
     int m_WindowHeight{};
+
+    // Strokes painted during the frame, handed to the simulation thread as a single edit
+    std::vector<BrushStroke> m_PendingStrokes{};
+    int m_BrushRadius{ 0 };
+
+    char m_PatternPath[260]{ "pattern.rle" };
+    int m_PatternOffset[2]{ 0, 0 };
+    bool m_ClearBeforeLoad{ true };
+
+    // Loads run on the simulation thread, which reports back through the message
+    std::mutex m_PatternMessageMutex{};
+    std::string m_PatternMessage{};
+
+    // The selection's bottom left cell and its size, set in its panel or by dragging on the board
+    // while the panel is open
+    int m_Selection[4]{ 0, 0, 32, 32 };
+    bool m_IsSelectionShown{ false };
+    bool m_IsSelectingWithMouse{ false };
+    glm::ivec2 m_SelectionAnchor{ 0 };
+    int m_PasteMode{ int(PasteMode::Replace) };
+
+    // Copied from the snapshot on screen. Pastes queued on the simulation thread share the board,
+    // so rotating or mirroring it makes a new one rather than changing it.
+    std::shared_ptr<const BoardState> m_Clipboard{};
+
+    char m_CheckpointPath[260]{ "board.ckpt" };
+    CheckpointSaver m_CheckpointSaver{};
+    std::string m_CheckpointMessage{};
 };
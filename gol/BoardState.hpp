@@ -0,0 +1,666 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Cells are stored as bits, 64 to a word. Every row starts on a word boundary
+// and the unused high bits of the last word in a row are always kept clear.
+typedef uint64_t CellWord;
+constexpr size_t CellsPerWord = 64;
+
+// The board is divided into tiles one word wide and as many rows tall, each with a flag
+// telling whether it changed since the previous generation. Untouched areas are skipped
+// by the step kernel.
+constexpr size_t TileSize = CellsPerWord;
+
+// Number of set bits in each byte of the word, left in that byte
+inline CellWord CountCellsPerByte(CellWord word) {
+    word = word - ((word >> 1) & 0x5555555555555555ull);
+    word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+    return (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+}
+
+// Number of set bits. MSVC's __popcnt64 needs a CPU with POPCNT, so it gets the portable version.
+inline int CountCells(CellWord word) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#else
+    return int((CountCellsPerByte(word) * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+// Index of the lowest set bit, the word must not be zero
+inline int FindFirstCell(CellWord word) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return int(index);
+#endif
+}
+
+// The word with its cells in the opposite order
+inline CellWord ReverseCells(CellWord word) {
+    word = ((word >> 1) & 0x5555555555555555ull) | ((word & 0x5555555555555555ull) << 1);
+    word = ((word >> 2) & 0x3333333333333333ull) | ((word & 0x3333333333333333ull) << 2);
+    word = ((word >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((word & 0x0F0F0F0F0F0F0F0Full) << 4);
+    word = ((word >> 8) & 0x00FF00FF00FF00FFull) | ((word & 0x00FF00FF00FF00FFull) << 8);
+    word = ((word >> 16) & 0x0000FFFF0000FFFFull) | ((word & 0x0000FFFF0000FFFFull) << 16);
+    return (word >> 32) | (word << 32);
+}
+
+// Transposes a 64x64 block of cells, one word per row, so that cell x of row y ends up as
+// cell y of row x. Swaps the off-diagonal quarters, then their quarters and so on, each
+// level in a single pass over the rows.
+inline void TransposeCells(CellWord block[CellsPerWord]) {
+    CellWord mask = 0x00000000FFFFFFFFull;
+    for (size_t half = CellsPerWord / 2; half != 0; half >>= 1, mask ^= mask << half) {
+        for (size_t y = 0; y < CellsPerWord; y = ((y | half) + 1) & ~half) {
+            CellWord swapped = ((block[y] >> half) ^ block[y | half]) & mask;
+            block[y] ^= swapped << half;
+            block[y | half] ^= swapped;
+        }
+    }
+}
+
+// Running total of bytes handed out for board storage. The iteration loop is
+// supposed to be allocation free, so any growth during a generation is a regression.
+inline std::atomic<uint64_t> g_BoardAllocatedBytes{ 0 };
+
+template <typename T>
+struct BoardAllocator {
+    typedef T value_type;
+
+    BoardAllocator() = default;
+    template <typename U> BoardAllocator(const BoardAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        g_BoardAllocatedBytes += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U> bool operator==(const BoardAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const BoardAllocator<U>&) const { return false; }
+};
+
+// Live cell counts of square blocks of 2^Log2BlockSize cells, row by row. Blocks along the
+// right and top edges are cut off by the board's edge, so they can hold fewer cells.
+struct DensityLevel {
+    int Log2BlockSize{ 0 };
+    size_t Width{ 0 };
+    size_t Height{ 0 };
+    std::vector<uint32_t> Counts{};
+
+    uint32_t GetCount(size_t x, size_t y) const { return Counts[y * Width + x]; }
+};
+
+// Blocks of the first pyramid level are 8x8, so that a byte can count each of them
+constexpr int DensityBaseLog2BlockSize = 3;
+
+// Generations rules keep cells that died around for a few generations. How long ago a dying
+// cell died, counting from 1, is stored in binary across extra bit planes laid out just like
+// the live cells, so a board takes 2 to 4 bits per cell. Live and dead cells have an age of 0.
+constexpr int MaxAgePlanes = 3;
+
+// How pasted cells combine with the ones on the board. Replace also copies dying cells over,
+// Or and Xor only take the live ones.
+enum class PasteMode {
+    Replace,
+    Or,
+    Xor,
+};
+
+class BoardState {
+public:
+    BoardState(size_t w, size_t h)
+        : m_Width(w)
+        , m_Height(h)
+        , m_Stride((w + CellsPerWord - 1) / CellsPerWord)
+        , m_Words(m_Stride * h)
+        , m_ChangedTiles(m_Stride * ((h + TileSize - 1) / TileSize), 1) {}
+
+    static BoardState GenerateTestBoard() {
+        BoardState result(100, 100);
+
+        for (size_t x = 0; x < result.GetWidth(); x++) {
+            result.SetCellState(x, 0, true);
+            result.SetCellState(x, result.GetHeight() - 1, true);
+        }
+
+        for (size_t y = 1; y < result.GetHeight() - 1; y++) {
+            result.SetCellState(0, y, true);
+            result.SetCellState(result.GetWidth() - 1, y, true);
+        }
+
+        return result;
+    }
+
+    bool IsInBounds(size_t x, size_t y) const {
+        return x < m_Width && y < m_Height;
+    }
+
+    bool GetCellState(int x, int y) const {
+        size_t cx = ClampX(x);
+        size_t cy = ClampY(y);
+        return (GetRow(cy)[cx / CellsPerWord] >> (cx % CellsPerWord)) & 1;
+    }
+
+    // Setting a cell's state also ends its dying, if it was
+    void SetCellState(int x, int y, bool state) {
+        size_t cx = ClampX(x);
+        size_t cy = ClampY(y);
+        CellWord bit = CellWord(1) << (cx % CellsPerWord);
+        CellWord& word = GetMutRow(cy)[cx / CellsPerWord];
+        word = state ? (word | bit) : (word & ~bit);
+        ClearAges(cy, cx / CellsPerWord, bit);
+        m_ChangedTiles[(cy / TileSize) * m_Stride + cx / CellsPerWord] = 1;
+        m_Density.IsStale = true;
+    }
+
+    // 0 for dead cells, 1 for live ones, and the age plus one for dying cells
+    int GetState(int x, int y) const {
+        if (GetCellState(x, y))
+            return 1;
+        size_t cx = ClampX(x);
+        size_t cy = ClampY(y);
+        int age = 0;
+        for (int plane = 0; plane < m_AgePlanes; plane++)
+            age |= int((GetAgeRow(plane, cy)[cx / CellsPerWord] >> (cx % CellsPerWord)) & 1) << plane;
+        return age == 0 ? 0 : age + 1;
+    }
+
+    // Ages that don't fit in the board's age planes are cut down to the bits that do
+    void SetState(int x, int y, int state) {
+        SetCellState(x, y, state == 1);
+        if (state < 2)
+            return;
+        size_t cx = ClampX(x);
+        size_t cy = ClampY(y);
+        for (int plane = 0; plane < m_AgePlanes; plane++) {
+            if (((state - 1) >> plane) & 1)
+                GetMutAgeRow(plane, cy)[cx / CellsPerWord] |= CellWord(1) << (cx % CellsPerWord);
+        }
+    }
+
+    // Sets count cells of row y, starting at column x and going right, wrapping around the torus.
+    // Works on whole words at a time, so it's the way to write long runs of cells.
+    void SetCellRun(size_t x, size_t y, size_t count, bool state) {
+        count = std::min(count, m_Width);
+        while (count > 0) {
+            size_t span = std::min(count, m_Width - x);
+            SetCellSpan(x, y, span, state);
+            count -= span;
+            x = 0;
+        }
+    }
+
+    size_t GetWidth() const {
+        return m_Width;
+    }
+
+    size_t GetHeight() const {
+        return m_Height;
+    }
+
+    // Number of words making up a single row
+    size_t GetStride() const {
+        return m_Stride;
+    }
+
+    const CellWord* GetRow(size_t y) const {
+        return &m_Words[y * m_Stride];
+    }
+
+    // Writing through the returned row doesn't flag any tiles as changed or invalidate the density
+    // pyramid, that's up to the caller. Rows may be written from several threads at once.
+    CellWord* GetMutRow(size_t y) {
+        return &m_Words[y * m_Stride];
+    }
+
+    int GetAgePlaneCount() const {
+        return m_AgePlanes;
+    }
+
+    // Resizes the age planes, dropping all dying cells
+    void SetAgePlaneCount(int planes) {
+        m_AgePlanes = std::clamp(planes, 0, MaxAgePlanes);
+        m_Ages.assign(m_Stride * m_Height * size_t(m_AgePlanes), 0);
+        MarkAllTilesChanged();
+    }
+
+    // Rows of an age plane, which holds one bit of every cell's age. Planes follow each other
+    // in memory, and their rows are written under the same rules as GetMutRow's.
+    const CellWord* GetAgeRow(int plane, size_t y) const {
+        return &m_Ages[(size_t(plane) * m_Height + y) * m_Stride];
+    }
+
+    CellWord* GetMutAgeRow(int plane, size_t y) {
+        return &m_Ages[(size_t(plane) * m_Height + y) * m_Stride];
+    }
+
+    size_t GetTileColumns() const {
+        return m_Stride;
+    }
+
+    size_t GetTileRows() const {
+        return (m_Height + TileSize - 1) / TileSize;
+    }
+
+    bool IsTileChanged(size_t tx, size_t ty) const {
+        return m_ChangedTiles[ty * m_Stride + tx] != 0;
+    }
+
+    void SetTileChanged(size_t tx, size_t ty, bool changed) {
+        m_ChangedTiles[ty * m_Stride + tx] = changed ? 1 : 0;
+    }
+
+    void MarkAllTilesChanged() {
+        std::fill(m_ChangedTiles.begin(), m_ChangedTiles.end(), 1);
+    }
+
+    // Mask of the bits of the last word in a row that hold actual cells
+    CellWord GetLastWordMask() const {
+        size_t used = m_Width % CellsPerWord;
+        return used == 0 ? ~CellWord(0) : (CellWord(1) << used) - 1;
+    }
+
+    size_t ClampX(int x) const {
+        if (x < 0) return m_Width + x;
+        if (size_t(x) >= m_Width) return x - m_Width;
+        return x;
+    }
+
+    size_t ClampY(int y) const {
+        if (y < 0) return m_Height + y;
+        if (size_t(y) >= m_Height) return y - m_Height;
+        return y;
+    }
+
+    // Paints a line of discs of the given radius, radius 0 being single cells. The ends can lie
+    // anywhere, they're wrapped around the torus as the line is drawn, so that a line crossing
+    // an edge comes out on the other side rather than going across the whole board.
+    void SetCellLine(int x1, int y1, int x2, int y2, bool state, int radius = 0) {
+        // Bresenham's, stepping one cell at a time along the longer axis
+        int dx = std::abs(x2 - x1);
+        int dy = -std::abs(y2 - y1);
+        int stepX = x1 < x2 ? 1 : -1;
+        int stepY = y1 < y2 ? 1 : -1;
+        int error = dx + dy;
+        while (true) {
+            SetCellDisc(x1, y1, radius, state);
+            if (x1 == x2 && y1 == y2)
+                break;
+            int doubled = error * 2;
+            if (doubled >= dy) {
+                error += dy;
+                x1 += stepX;
+            }
+            if (doubled <= dx) {
+                error += dx;
+                y1 += stepY;
+            }
+        }
+    }
+
+    // Sets the cells within radius of the center, as one run per row
+    void SetCellDisc(int x, int y, int radius, bool state) {
+        int half = radius;
+        for (int dy = 0; dy <= radius; dy++) {
+            while (half * half + dy * dy > radius * radius)
+                half--;
+            size_t left = Wrap(x - half, m_Width);
+            SetCellRun(left, Wrap(y + dy, m_Height), size_t(half) * 2 + 1, state);
+            if (dy != 0)
+                SetCellRun(left, Wrap(y - dy, m_Height), size_t(half) * 2 + 1, state);
+        }
+    }
+
+    // Region operations. A region starts at any cell and wraps around the torus like the runs
+    // of SetCellRun do, and is cut down to the board's size. They all work on whole words at a
+    // time, shifting rows into place where the columns don't line up.
+    void FillRegion(int x, int y, size_t w, size_t h, bool state) {
+        h = std::min(h, m_Height);
+        for (size_t dy = 0; dy < h; dy++)
+            SetCellRun(Wrap(x, m_Width), Wrap(y + int(dy), m_Height), w, state);
+    }
+
+    // Dying cells come back to life, just like dead ones
+    void InvertRegion(int x, int y, size_t w, size_t h) {
+        h = std::min(h, m_Height);
+        for (size_t dy = 0; dy < h; dy++) {
+            size_t row = Wrap(y + int(dy), m_Height);
+            CellWord* words = GetMutRow(row);
+            ForEachSpan(x, w, [&](size_t begin, size_t, size_t count) {
+                ForEachSpanWord(begin, row, count, [&](size_t i, CellWord mask) {
+                    words[i] ^= mask;
+                    ClearAges(row, i, mask);
+                });
+            });
+        }
+    }
+
+    // A board as big as the region, holding its cells, dying ones included
+    BoardState CopyRegion(int x, int y, size_t w, size_t h) const {
+        BoardState result(std::min(w, m_Width), std::min(h, m_Height));
+        result.SetAgePlaneCount(m_AgePlanes);
+        for (size_t dy = 0; dy < result.m_Height; dy++) {
+            size_t row = Wrap(y + int(dy), m_Height);
+            ForEachSpan(x, result.m_Width, [&](size_t begin, size_t offset, size_t count) {
+                result.BlitSpan(offset, dy, *this, begin, row, count, PasteMode::Replace);
+            });
+        }
+        return result;
+    }
+
+    // Pastes another board, usually one from CopyRegion, with its bottom left corner at x, y.
+    // Dying cells are cut down to this board's age planes, as in SetState.
+    void PasteRegion(const BoardState& block, int x, int y, PasteMode mode) {
+        size_t h = std::min(block.m_Height, m_Height);
+        for (size_t dy = 0; dy < h; dy++) {
+            size_t row = Wrap(y + int(dy), m_Height);
+            ForEachSpan(x, block.m_Width, [&](size_t begin, size_t offset, size_t count) {
+                BlitSpan(begin, row, block, offset, dy, count, mode);
+            });
+        }
+    }
+
+    // The board turned a quarter counterclockwise, with y going up as it's drawn, so its bottom
+    // row becomes the right column. Each 64x64 tile is transposed into place, the rows are then
+    // mirrored.
+    BoardState Rotated() const {
+        BoardState result(m_Height, m_Width);
+        result.SetAgePlaneCount(m_AgePlanes);
+        CellWord block[CellsPerWord];
+        for (int plane = -1; plane < m_AgePlanes; plane++) {
+            for (size_t ty = 0; ty < GetTileRows(); ty++) {
+                size_t rows = std::min(TileSize, m_Height - ty * TileSize);
+                for (size_t tx = 0; tx < m_Stride; tx++) {
+                    for (size_t i = 0; i < CellsPerWord; i++)
+                        block[i] = i < rows ? GetPlaneRow(plane, ty * TileSize + i)[tx] : 0;
+                    TransposeCells(block);
+                    size_t columns = std::min(CellsPerWord, m_Width - tx * CellsPerWord);
+                    for (size_t i = 0; i < columns; i++)
+                        result.GetMutPlaneRow(plane, tx * CellsPerWord + i)[ty] = block[i];
+                }
+            }
+        }
+        result.MirrorX();
+        return result;
+    }
+
+    // Mirrors the board left to right. Reversing a row's words and their cells leaves the row
+    // shifted left by the unused bits of its last word, which are shifted back out.
+    void MirrorX() {
+        size_t unused = m_Stride * CellsPerWord - m_Width;
+        std::vector<CellWord> reversed(m_Stride);
+        for (int plane = -1; plane < m_AgePlanes; plane++) {
+            for (size_t y = 0; y < m_Height; y++) {
+                CellWord* row = GetMutPlaneRow(plane, y);
+                for (size_t i = 0; i < m_Stride; i++)
+                    reversed[i] = ReverseCells(row[m_Stride - 1 - i]);
+                for (size_t i = 0; i < m_Stride; i++)
+                    row[i] = ReadCells(reversed.data(), m_Stride, i * CellsPerWord + unused);
+            }
+        }
+        MarkAllTilesChanged();
+        m_Density.IsStale = true;
+    }
+
+    // Mirrors the board top to bottom
+    void MirrorY() {
+        for (int plane = -1; plane < m_AgePlanes; plane++) {
+            for (size_t y = 0; y < m_Height / 2; y++) {
+                CellWord* row = GetMutPlaneRow(plane, y);
+                std::swap_ranges(row, row + m_Stride, GetMutPlaneRow(plane, m_Height - 1 - y));
+            }
+        }
+        MarkAllTilesChanged();
+        m_Density.IsStale = true;
+    }
+
+    void Clear() {
+        std::fill(m_Words.begin(), m_Words.end(), 0);
+        std::fill(m_Ages.begin(), m_Ages.end(), 0);
+        MarkAllTilesChanged();
+        m_Density.IsStale = true;
+    }
+
+    // Population counts of ever larger blocks, from 8x8 up to a single block covering the whole
+    // board. Built on first use after the cells change, so it's for boards only one thread reads.
+    const std::vector<DensityLevel>& GetDensityPyramid() const {
+        if (m_Density.IsStale)
+            BuildDensityPyramid();
+        return m_Density.Levels;
+    }
+
+    void InvalidateDensityPyramid() {
+        m_Density.IsStale = true;
+    }
+
+    // Number of live cells. Relies on the padding bits being clear.
+    uint64_t CountPopulation() const {
+        uint64_t population = 0;
+        for (CellWord word : m_Words)
+            population += CountCells(word);
+        return population;
+    }
+
+    int CountNeighbors(int x, int y) const {
+        int neighbors = 0;
+        neighbors += GetCellState(x - 1, y - 1) ? 1 : 0;
+        neighbors += GetCellState(x + 0, y - 1) ? 1 : 0;
+        neighbors += GetCellState(x + 1, y - 1) ? 1 : 0;
+        neighbors += GetCellState(x - 1, y + 0) ? 1 : 0;
+        neighbors += GetCellState(x + 1, y + 0) ? 1 : 0;
+        neighbors += GetCellState(x - 1, y + 1) ? 1 : 0;
+        neighbors += GetCellState(x + 0, y + 1) ? 1 : 0;
+        neighbors += GetCellState(x + 1, y + 1) ? 1 : 0;
+        return neighbors;
+    }
+
+private:
+    // Any coordinate wrapped into [0, size), however far off the board it is
+    static size_t Wrap(int value, size_t size) {
+        long long wrapped = value % (long long)size;
+        return size_t(wrapped < 0 ? wrapped + (long long)size : wrapped);
+    }
+
+    // The live cells for plane -1, the age planes from 0 up
+    const CellWord* GetPlaneRow(int plane, size_t y) const {
+        return plane < 0 ? GetRow(y) : GetAgeRow(plane, y);
+    }
+
+    CellWord* GetMutPlaneRow(int plane, size_t y) {
+        return plane < 0 ? GetMutRow(y) : GetMutAgeRow(plane, y);
+    }
+
+    // 64 cells of a row from column x on, those past the row's last word reading as dead
+    static CellWord ReadCells(const CellWord* row, size_t words, size_t x) {
+        size_t word = x / CellsPerWord;
+        size_t shift = x % CellsPerWord;
+        CellWord cells = row[word] >> shift;
+        if (shift != 0 && word + 1 < words)
+            cells |= row[word + 1] << (CellsPerWord - shift);
+        return cells;
+    }
+
+    // Splits count cells from column x on into spans that don't cross the right edge, calling
+    // f(column, offset from x, length) for each
+    template <typename F>
+    void ForEachSpan(int x, size_t count, F f) const {
+        count = std::min(count, m_Width);
+        size_t column = Wrap(x, m_Width);
+        size_t offset = 0;
+        while (offset < count) {
+            size_t span = std::min(count - offset, m_Width - column);
+            f(column, offset, span);
+            offset += span;
+            column = 0;
+        }
+    }
+
+    // Calls f(word, mask of the span's cells in it) for each word of a span in row y, which
+    // mustn't cross the right edge, and flags their tiles as changed
+    template <typename F>
+    void ForEachSpanWord(size_t x, size_t y, size_t count, F f) {
+        size_t end = x + count;
+        size_t first = x / CellsPerWord;
+        size_t last = (end - 1) / CellsPerWord;
+        for (size_t i = first; i <= last; i++) {
+            size_t begin = i == first ? x % CellsPerWord : 0;
+            size_t stop = i == last ? (end - 1) % CellsPerWord + 1 : CellsPerWord;
+            CellWord mask = (stop == CellsPerWord ? ~CellWord(0) : (CellWord(1) << stop) - 1) & ~((CellWord(1) << begin) - 1);
+            f(i, mask);
+            m_ChangedTiles[(y / TileSize) * m_Stride + i] = 1;
+        }
+        m_Density.IsStale = true;
+    }
+
+    // SetCellRun for a span that doesn't cross the right edge
+    void SetCellSpan(size_t x, size_t y, size_t count, bool state) {
+        CellWord* row = GetMutRow(y);
+        ForEachSpanWord(x, y, count, [&](size_t i, CellWord mask) {
+            row[i] = state ? (row[i] | mask) : (row[i] & ~mask);
+            ClearAges(y, i, mask);
+        });
+    }
+
+    // Combines count cells of the source's row srcY, from column srcX on, into row y from column x
+    // on, a word at a time. Neither span may cross its board's right edge.
+    void BlitSpan(size_t x, size_t y, const BoardState& source, size_t srcX, size_t srcY, size_t count, PasteMode mode) {
+        CellWord* row = GetMutRow(y);
+        ForEachSpanWord(x, y, count, [&](size_t i, CellWord mask) {
+            // The source cells lined up with word i, shifted along if the span starts within it
+            size_t start = std::max(x, i * CellsPerWord);
+            size_t column = srcX + start - x;
+            auto read = [&](const CellWord* sourceRow) {
+                return (ReadCells(sourceRow, source.m_Stride, column) << (start % CellsPerWord)) & mask;
+            };
+
+            CellWord cells = read(source.GetRow(srcY));
+            if (mode == PasteMode::Replace) {
+                row[i] = (row[i] & ~mask) | cells;
+                for (int plane = 0; plane < m_AgePlanes; plane++) {
+                    CellWord ages = plane < source.m_AgePlanes ? read(source.GetAgeRow(plane, srcY)) : 0;
+                    CellWord& word = GetMutAgeRow(plane, y)[i];
+                    word = (word & ~mask) | ages;
+                }
+            } else {
+                row[i] = mode == PasteMode::Or ? row[i] | cells : row[i] ^ cells;
+                ClearAges(y, i, cells);
+            }
+        });
+    }
+
+    void ClearAges(size_t y, size_t word, CellWord mask) {
+        for (int plane = 0; plane < m_AgePlanes; plane++)
+            GetMutAgeRow(plane, y)[word] &= ~mask;
+    }
+
+    void BuildDensityPyramid() const {
+        std::vector<DensityLevel>& levels = m_Density.Levels;
+        size_t blockSize = size_t(1) << DensityBaseLog2BlockSize;
+        size_t blocksPerWord = CellsPerWord / blockSize;
+
+        // The first level sums per byte popcounts of 8 rows, giving 8 block counts per word
+        size_t levelCount = 1;
+        levels.resize(std::max<size_t>(levels.size(), 1));
+        DensityLevel& base = levels[0];
+        base.Log2BlockSize = DensityBaseLog2BlockSize;
+        base.Width = (m_Width + blockSize - 1) / blockSize;
+        base.Height = (m_Height + blockSize - 1) / blockSize;
+        base.Counts.resize(base.Width * base.Height);
+        m_Density.Sums.resize(m_Stride);
+
+        for (size_t by = 0; by < base.Height; by++) {
+            std::fill(m_Density.Sums.begin(), m_Density.Sums.end(), 0);
+            size_t endY = std::min(m_Height, (by + 1) * blockSize);
+            for (size_t y = by * blockSize; y < endY; y++) {
+                const CellWord* row = GetRow(y);
+                for (size_t i = 0; i < m_Stride; i++)
+                    m_Density.Sums[i] += CountCellsPerByte(row[i]);
+            }
+
+            // Only the last word of a row can hold fewer than 8 blocks
+            uint32_t* counts = &base.Counts[by * base.Width];
+            size_t fullWords = base.Width / blocksPerWord;
+            for (size_t i = 0; i < fullWords; i++) {
+                CellWord sums = m_Density.Sums[i];
+                for (size_t j = 0; j < blocksPerWord; j++)
+                    counts[i * blocksPerWord + j] = uint32_t((sums >> (j * 8)) & 0xFF);
+            }
+            CellWord sums = fullWords < m_Stride ? m_Density.Sums[fullWords] : 0;
+            for (size_t bx = fullWords * blocksPerWord; bx < base.Width; bx++, sums >>= 8)
+                counts[bx] = uint32_t(sums & 0xFF);
+        }
+
+        // Every further level adds up 2x2 blocks of the one below it
+        while (levels[levelCount - 1].Width > 1 || levels[levelCount - 1].Height > 1) {
+            levels.resize(std::max(levels.size(), levelCount + 1));
+            const DensityLevel& below = levels[levelCount - 1];
+            DensityLevel& level = levels[levelCount];
+            level.Log2BlockSize = below.Log2BlockSize + 1;
+            level.Width = (below.Width + 1) / 2;
+            level.Height = (below.Height + 1) / 2;
+            level.Counts.resize(level.Width * level.Height);
+
+            // An odd row or column at the end has nothing to pair up with
+            for (size_t y = 0; y < level.Height; y++) {
+                const uint32_t* lower = &below.Counts[y * 2 * below.Width];
+                const uint32_t* upper = y * 2 + 1 < below.Height ? lower + below.Width : nullptr;
+                uint32_t* counts = &level.Counts[y * level.Width];
+                size_t pairs = below.Width / 2;
+                for (size_t x = 0; x < pairs; x++) {
+                    uint32_t count = lower[x * 2] + lower[x * 2 + 1];
+                    if (upper)
+                        count += upper[x * 2] + upper[x * 2 + 1];
+                    counts[x] = count;
+                }
+                if (pairs < level.Width)
+                    counts[pairs] = lower[pairs * 2] + (upper ? upper[pairs * 2] : 0);
+            }
+            levelCount++;
+        }
+
+        // Levels left over from a bigger board are dropped, their storage isn't worth keeping
+        levels.resize(levelCount);
+        m_Density.IsStale = false;
+    }
+
+    // Copies of the board start with a stale pyramid of their own, keeping whatever storage
+    // they already had, so publishing a snapshot never copies or allocates pyramid levels
+    struct DensityCache {
+        DensityCache() = default;
+        DensityCache(const DensityCache&) {}
+        DensityCache& operator=(const DensityCache&) {
+            IsStale = true;
+            return *this;
+        }
+
+        std::vector<DensityLevel> Levels{};
+        std::vector<CellWord> Sums{};
+        bool IsStale{ true };
+    };
+
+    size_t m_Width;
+    size_t m_Height;
+    size_t m_Stride;
+    std::vector<CellWord, BoardAllocator<CellWord>> m_Words;
+    std::vector<uint8_t, BoardAllocator<uint8_t>> m_ChangedTiles;
+    std::vector<CellWord, BoardAllocator<CellWord>> m_Ages{};
+    int m_AgePlanes{ 0 };
+    mutable DensityCache m_Density{};
+};
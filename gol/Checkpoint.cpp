@@ -0,0 +1,264 @@
+#include "Checkpoint.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char CheckpointMagic[8] = { 'G', 'O', 'L', 'C', 'K', 'P', 'T', 0 };
+
+// Bumped whenever the header or the row layout changes. Version 2 added the age planes
+// of Generations rules after the rows, so version 1 files still read as boards without them.
+static constexpr uint32_t CheckpointVersion = 2;
+static constexpr uint32_t OldestCheckpointVersion = 1;
+
+// Far beyond any board that fits in memory, and small enough that the plane sizes computed
+// from an untrusted header can't overflow
+static constexpr uint64_t MaxCheckpointSide = uint64_t(1) << 24;
+
+// Stored as is, so files are only portable between little endian machines.
+// A big endian reader would see a garbled version and reject the file.
+struct CheckpointHeader {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t HeaderSize;
+    uint64_t Width;
+    uint64_t Height;
+    uint64_t Stride;
+    int64_t Generation;
+    uint64_t DataOffset;
+    uint64_t DataSize;
+    char Rule[64];
+};
+static_assert(sizeof(CheckpointHeader) == 128, "the checkpoint header layout is part of the file format");
+
+// Read only view of a whole file
+class MappedFile {
+public:
+    ~MappedFile() { Close(); }
+
+    bool Open(const std::string& path) {
+#ifdef _WIN32
+        m_File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_File == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_File, &size) || size.QuadPart == 0)
+            return false;
+        m_Size = size_t(size.QuadPart);
+
+        m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_Mapping)
+            return false;
+        m_Data = (const uint8_t*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+        return m_Data != nullptr;
+#else
+        m_File = open(path.c_str(), O_RDONLY);
+        if (m_File < 0)
+            return false;
+
+        struct stat status;
+        if (fstat(m_File, &status) != 0 || status.st_size == 0)
+            return false;
+        m_Size = size_t(status.st_size);
+
+        void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, m_File, 0);
+        if (data == MAP_FAILED)
+            return false;
+        madvise(data, m_Size, MADV_SEQUENTIAL);
+        m_Data = (const uint8_t*)data;
+        return true;
+#endif
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (m_Data)
+            UnmapViewOfFile(m_Data);
+        if (m_Mapping)
+            CloseHandle(m_Mapping);
+        if (m_File != INVALID_HANDLE_VALUE)
+            CloseHandle(m_File);
+        m_Mapping = nullptr;
+        m_File = INVALID_HANDLE_VALUE;
+#else
+        if (m_Data)
+            munmap((void*)m_Data, m_Size);
+        if (m_File >= 0)
+            close(m_File);
+        m_File = -1;
+#endif
+        m_Data = nullptr;
+        m_Size = 0;
+    }
+
+    const uint8_t* GetData() const { return m_Data; }
+    size_t GetSize() const { return m_Size; }
+
+private:
+#ifdef _WIN32
+    HANDLE m_File{ INVALID_HANDLE_VALUE };
+    HANDLE m_Mapping{ nullptr };
+#else
+    int m_File{ -1 };
+#endif
+    const uint8_t* m_Data{ nullptr };
+    size_t m_Size{ 0 };
+};
+
+bool SaveCheckpoint(const std::string& path, const Checkpoint& checkpoint, std::string& error) {
+    const BoardState& board = checkpoint.Board;
+
+    CheckpointHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.Magic, CheckpointMagic, sizeof(header.Magic));
+    header.Version = CheckpointVersion;
+    header.HeaderSize = sizeof(CheckpointHeader);
+    header.Width = board.GetWidth();
+    header.Height = board.GetHeight();
+    header.Stride = board.GetStride();
+    header.Generation = checkpoint.Generation;
+    header.DataOffset = sizeof(CheckpointHeader);
+    uint64_t planeSize = board.GetStride() * board.GetHeight() * sizeof(CellWord);
+    header.DataSize = planeSize * uint64_t(1 + board.GetAgePlaneCount());
+    std::strncpy(header.Rule, checkpoint.Rule.c_str(), sizeof(header.Rule) - 1);
+
+    std::string temporaryPath = path + ".tmp";
+    std::FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+    if (!file) {
+        error = "can't create " + temporaryPath;
+        return false;
+    }
+
+    // Rows are contiguous, so the whole board goes out in one write, and so do the age planes
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    if (written && planeSize > 0)
+        written = std::fwrite(board.GetRow(0), size_t(planeSize), 1, file) == 1;
+    if (written && planeSize > 0 && board.GetAgePlaneCount() > 0)
+        written = std::fwrite(board.GetAgeRow(0, 0), size_t(planeSize) * board.GetAgePlaneCount(), 1, file) == 1;
+    written = std::fclose(file) == 0 && written;
+    if (!written) {
+        std::remove(temporaryPath.c_str());
+        error = "can't write " + temporaryPath;
+        return false;
+    }
+
+    // Windows' rename won't replace an existing file, elsewhere it's already atomic
+#ifdef _WIN32
+    bool renamed = MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool renamed = std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!renamed) {
+        error = "can't rename " + temporaryPath + " to " + path;
+        return false;
+    }
+    return true;
+}
+
+bool LoadCheckpoint(const std::string& path, Checkpoint& checkpoint, std::string& error) {
+    MappedFile file;
+    if (!file.Open(path)) {
+        error = "can't map " + path;
+        return false;
+    }
+
+    CheckpointHeader header;
+    if (file.GetSize() < sizeof(header)) {
+        error = path + " is too short to be a checkpoint";
+        return false;
+    }
+    std::memcpy(&header, file.GetData(), sizeof(header));
+
+    if (std::memcmp(header.Magic, CheckpointMagic, sizeof(header.Magic)) != 0) {
+        error = path + " isn't a checkpoint";
+        return false;
+    }
+    if (header.Version < OldestCheckpointVersion || header.Version > CheckpointVersion || header.HeaderSize != sizeof(CheckpointHeader)) {
+        error = path + " has unsupported checkpoint version " + std::to_string(header.Version);
+        return false;
+    }
+
+    if (header.Width == 0 || header.Height == 0 || header.Width > MaxCheckpointSide || header.Height > MaxCheckpointSide) {
+        error = path + " has an unsupported board size " + std::to_string(header.Width) + "x" + std::to_string(header.Height);
+        return false;
+    }
+
+    // The data is the rows followed by any age planes, each plane the same size as the rows
+    uint64_t stride = (header.Width + CellsPerWord - 1) / CellsPerWord;
+    uint64_t planeSize = stride * header.Height * sizeof(CellWord);
+    uint64_t planes = header.DataSize / planeSize;
+    if (header.Stride != stride || header.DataSize != planeSize * planes || planes < 1 || planes > uint64_t(1 + MaxAgePlanes)
+        || header.DataOffset < sizeof(header) || header.DataOffset > file.GetSize()
+        || header.DataSize > file.GetSize() - header.DataOffset) {
+        error = path + " has an inconsistent header or is truncated";
+        return false;
+    }
+
+    BoardState board(size_t(header.Width), size_t(header.Height));
+    const uint8_t* data = file.GetData() + header.DataOffset;
+    std::memcpy(board.GetMutRow(0), data, size_t(planeSize));
+    board.SetAgePlaneCount(int(planes - 1));
+    for (int plane = 0; plane < board.GetAgePlaneCount(); plane++)
+        std::memcpy(board.GetMutAgeRow(plane, 0), data + planeSize * uint64_t(1 + plane), size_t(planeSize));
+
+    // The padding bits are assumed clear everywhere else, so don't trust the file on that
+    CellWord lastMask = board.GetLastWordMask();
+    for (size_t y = 0; y < board.GetHeight(); y++) {
+        board.GetMutRow(y)[board.GetStride() - 1] &= lastMask;
+        for (int plane = 0; plane < board.GetAgePlaneCount(); plane++)
+            board.GetMutAgeRow(plane, y)[board.GetStride() - 1] &= lastMask;
+    }
+
+    header.Rule[sizeof(header.Rule) - 1] = 0;
+    checkpoint.Board = std::move(board);
+    checkpoint.Generation = header.Generation;
+    checkpoint.Rule = header.Rule;
+    return true;
+}
+
+void CheckpointSaver::Start(const std::string& path, Checkpoint checkpoint) {
+    Wait();
+
+    m_IsBusy = true;
+    m_Thread = std::thread([this, path, checkpoint = std::move(checkpoint)]() {
+        auto start = std::chrono::steady_clock::now();
+        std::string error;
+        bool saved = SaveCheckpoint(path, checkpoint, error);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(m_StatusMutex);
+            if (saved) {
+                char status[64];
+                std::snprintf(status, sizeof(status), " (generation %lld, %.2f s)", checkpoint.Generation, seconds);
+                m_Status = "Saved " + path + status;
+            } else {
+                m_Status = "Error: " + error;
+            }
+        }
+        m_IsBusy = false;
+    });
+}
+
+void CheckpointSaver::Wait() {
+    if (m_Thread.joinable())
+        m_Thread.join();
+}
+
+std::string CheckpointSaver::GetStatus() const {
+    std::lock_guard<std::mutex> lock(m_StatusMutex);
+    return m_Status;
+}
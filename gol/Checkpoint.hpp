@@ -0,0 +1,49 @@
+#pragma once
+
+#include "BoardState.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Checkpoint files hold a board in its in-memory layout: a fixed size header followed by
+// the raw rows, padding bits included, and the age planes of Generations rules if any.
+// Saving is a single write of the row storage, and loading is a single copy out of a
+// memory mapped file, with no parsing in between.
+// The header records the layout version, the board size, the generation counter and the
+// rule, so a file can be rejected up front instead of being misread.
+
+struct Checkpoint {
+    BoardState Board{ 0, 0 };
+    long long Generation{ 0 };
+    std::string Rule{};
+};
+
+// Writes to a temporary file next to path and renames it into place once it's complete,
+// so an interrupted save never leaves a truncated checkpoint behind
+bool SaveCheckpoint(const std::string& path, const Checkpoint& checkpoint, std::string& error);
+
+bool LoadCheckpoint(const std::string& path, Checkpoint& checkpoint, std::string& error);
+
+// Saves checkpoints on a thread of its own, so the caller only pays for taking the snapshot
+class CheckpointSaver {
+public:
+    ~CheckpointSaver() { Wait(); }
+
+    // Starts saving the checkpoint in the background, first waiting for the previous save if
+    // it hasn't finished yet
+    void Start(const std::string& path, Checkpoint checkpoint);
+    void Wait();
+
+    bool IsBusy() const { return m_IsBusy; }
+
+    // Describes how the last finished save went, empty if there hasn't been one
+    std::string GetStatus() const;
+
+private:
+    std::thread m_Thread{};
+    std::atomic<bool> m_IsBusy{ false };
+    mutable std::mutex m_StatusMutex{};
+    std::string m_Status{};
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <string_view>
 #include <SDL.h>
 
@@ -7,18 +8,23 @@ void FatalError(std::string_view message, std::string_view caption, bool exit =
 void FatalErrorSDL(std::string_view prefix, std::string_view caption, bool exit = true);
 void YieldControl();
 
+// Based on the steady clock rather than SDL_GetTicks, which only has millisecond resolution
 class Timer {
 public:
     void Start() {
-        m_Start = SDL_GetTicks();
+        m_Start = std::chrono::steady_clock::now();
+    }
+
+    double GetPassedSeconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
     }
 
     Uint32 GetPassedMillis() const {
-        return SDL_GetTicks() - m_Start;
+        return Uint32(GetPassedSeconds() * 1000.0);
     }
 
 private:
-    Uint32 m_Start{ 0 };
+    std::chrono::steady_clock::time_point m_Start{ std::chrono::steady_clock::now() };
 };
 
 class RateCounter {
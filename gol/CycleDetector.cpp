@@ -0,0 +1,85 @@
+#include "CycleDetector.hpp"
+
+#include <algorithm>
+
+// Mixes a word with its index among the board's words, cells then age planes, with
+// splitmix64's finalizer. Equal words in different places then hash differently, and
+// don't cancel each other out in the XOR.
+static inline uint64_t MixWord(uint64_t index, CellWord word) {
+    uint64_t z = word + index * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+bool CycleDetector::Update(const BoardState& board, long long generation) {
+    size_t columns = board.GetTileColumns();
+    size_t rows = board.GetTileRows();
+    bool rehashAll = m_IsStale || m_TileHashes.size() != columns * rows || m_AgePlanes != board.GetAgePlaneCount();
+    if (rehashAll) {
+        m_TileHashes.assign(columns * rows, 0);
+        m_AgePlanes = board.GetAgePlaneCount();
+        m_Hash = 0;
+        m_IsStale = false;
+    }
+
+    // Changed tiles of a tile row are hashed together, row by row, so that memory is read in order
+    size_t stride = board.GetStride();
+    size_t height = board.GetHeight();
+    for (size_t ty = 0; ty < rows; ty++) {
+        m_ChangedColumns.clear();
+        for (size_t tx = 0; tx < columns; tx++) {
+            if (rehashAll || board.IsTileChanged(tx, ty))
+                m_ChangedColumns.push_back(tx);
+        }
+        if (m_ChangedColumns.empty())
+            continue;
+
+        size_t count = m_ChangedColumns.size();
+        const size_t* changed = m_ChangedColumns.data();
+        m_RowHashes.assign(count, 0);
+        uint64_t* hashes = m_RowHashes.data();
+        size_t yEnd = std::min(height, (ty + 1) * TileSize);
+        for (int plane = -1; plane < m_AgePlanes; plane++) {
+            for (size_t y = ty * TileSize; y < yEnd; y++) {
+                const CellWord* row = plane < 0 ? board.GetRow(y) : board.GetAgeRow(plane, y);
+                size_t base = ((plane + 1) * height + y) * stride;
+                for (size_t i = 0; i < count; i++)
+                    hashes[i] ^= MixWord(base + changed[i], row[changed[i]]);
+            }
+        }
+
+        for (size_t i = 0; i < m_ChangedColumns.size(); i++) {
+            uint64_t& tileHash = m_TileHashes[ty * columns + m_ChangedColumns[i]];
+            m_Hash ^= tileHash ^ m_RowHashes[i];
+            tileHash = m_RowHashes[i];
+        }
+    }
+
+    // The most recent match gives the shortest period
+    bool found = false;
+    if (m_Period == 0) {
+        for (size_t i = 1; i <= m_HistoryCount; i++) {
+            const Entry& entry = m_History[(m_HistoryNext + HistoryLength - i) % HistoryLength];
+            if (entry.Hash == m_Hash) {
+                m_Period = generation - entry.Generation;
+                m_Onset = entry.Generation;
+                found = true;
+                break;
+            }
+        }
+    }
+
+    m_History[m_HistoryNext] = { m_Hash, generation };
+    m_HistoryNext = (m_HistoryNext + 1) % HistoryLength;
+    m_HistoryCount = std::min(m_HistoryCount + 1, HistoryLength);
+    return found;
+}
+
+void CycleDetector::Reset() {
+    m_IsStale = true;
+    m_HistoryCount = 0;
+    m_HistoryNext = 0;
+    m_Period = 0;
+    m_Onset = 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "BoardState.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Notices the board repeating itself. Keeps a 64 bit hash of the board, the XOR of a hash per
+// tile, and only rehashes the tiles flagged as changed, so keeping it up to date costs little
+// next to stepping those tiles. The hashes of the last HistoryLength generations are kept in a
+// ring, and a generation whose hash is in there repeats an earlier one.
+//
+// A match is taken as a repetition without comparing the boards, two different boards having
+// the same 64 bit hash is unlikely enough.
+class CycleDetector {
+public:
+    // Longest period that can be found
+    static constexpr size_t HistoryLength = 64;
+
+    // Brings the hash up to date with the board at the given generation, and looks for it among
+    // the earlier ones. The board's tile flags must cover every change since the last update,
+    // or the detector must have been reset. Returns true if this found a cycle.
+    bool Update(const BoardState& board, long long generation);
+
+    // Forgets the earlier generations and rehashes the whole board on the next update. Needed after
+    // edits and rule changes, when the earlier generations no longer lead to the current one.
+    void Reset();
+
+    bool IsStale() const { return m_IsStale; }
+    uint64_t GetHash() const { return m_Hash; }
+
+    // Period of the cycle in generations, 0 until one is found. Found as soon as the board repeats,
+    // so the onset is the first generation of the cycle. When updates skip generations, as with
+    // HashLife, the true period divides the reported one and the onset may be earlier.
+    long long GetPeriod() const { return m_Period; }
+    long long GetOnsetGeneration() const { return m_Onset; }
+
+private:
+    struct Entry {
+        uint64_t Hash;
+        long long Generation;
+    };
+
+    std::vector<uint64_t> m_TileHashes{};
+    int m_AgePlanes{ 0 };
+    uint64_t m_Hash{ 0 };
+    bool m_IsStale{ true };
+
+    // Scratch for the tile row being hashed
+    std::vector<size_t> m_ChangedColumns{};
+    std::vector<uint64_t> m_RowHashes{};
+
+    Entry m_History[HistoryLength]{};
+    size_t m_HistoryCount{ 0 };
+    size_t m_HistoryNext{ 0 };
+
+    long long m_Period{ 0 };
+    long long m_Onset{ 0 };
+};
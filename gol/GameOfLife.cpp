@@ -1,79 +1,416 @@
 #include "GameOfLife.hpp"
-#include "Common.hpp"
-#include <imgui.h>
-#include <cinttypes>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 
-static float t = 0;
+// Longest stretch of missed iterations a fixed rate run will try to catch up on
+static constexpr double MaxCatchUpSeconds = 0.25;
 
-void IterationController::Process(float delta) {
-    if (m_IsPaused)
+// How often the measured iteration rate is refreshed
+static constexpr double RateWindowSeconds = 0.5;
+
+void IterationController::StartThread() {
+    if (m_Thread.joinable())
+        return;
+    m_IsThreadStopping = false;
+    m_Thread = std::thread(&IterationController::ThreadMain, this);
+}
+
+void IterationController::StopThread() {
+    if (!m_Thread.joinable())
         return;
-    
-    float nya = 1.0f / float(m_IterationsPerSecond);
-    t += delta;
-    if (t < nya) {
+    {
+        std::lock_guard<std::mutex> lock(m_EditMutex);
+        m_IsThreadStopping = true;
+    }
+    m_EditCondition.notify_one();
+    m_Thread.join();
+}
+
+void IterationController::ThreadMain() {
+    PublishSnapshot();
+
+    auto lastTick = std::chrono::steady_clock::now();
+    while (!m_IsThreadStopping) {
+        bool edited = ApplyEdits();
+
+        auto now = std::chrono::steady_clock::now();
+        float delta = std::chrono::duration<float>(now - lastTick).count();
+        lastTick = now;
+
+        if (Process(delta) > 0 || edited)
+            PublishSnapshot();
+
+        // Sleep until the next iteration is due, waking up early if an edit comes in or the
+        // iteration is resumed
+        bool wasPaused = m_IsPaused;
+        double sleep = wasPaused ? 0.1 : GetSecondsUntilNextIteration();
+        if (sleep <= 0)
+            continue;
+
+        std::unique_lock<std::mutex> lock(m_EditMutex);
+        m_EditCondition.wait_for(lock, std::chrono::duration<double>(sleep), [&] {
+            return m_IsThreadStopping || !m_PendingEdits.empty() || (wasPaused && !m_IsPaused);
+        });
+    }
+}
+
+bool IterationController::ApplyEdits() {
+    {
+        std::lock_guard<std::mutex> lock(m_EditMutex);
+        std::swap(m_PendingEdits, m_ApplyingEdits);
+    }
+
+    for (BoardEdit& edit : m_ApplyingEdits)
+        edit(GetMutBoard());
+
+    bool applied = !m_ApplyingEdits.empty();
+    if (applied) {
+        AccumulateDirtyTiles(GetBoard());
+        DetectCycle();
+        RecountPopulation();
+    }
+    m_ApplyingEdits.clear();
+    return applied;
+}
+
+void IterationController::AccumulateDirtyTiles(const BoardState& board) {
+    size_t columns = board.GetTileColumns();
+    size_t rows = board.GetTileRows();
+    if (m_DirtyTiles.size() != columns * rows) {
+        // A board of another size is new in its entirety
+        m_DirtyTiles.assign(columns * rows, 1);
+        m_TileSerials.assign(columns * rows, 0);
         return;
     }
-    t = 0;
-
-    auto iterations = std::ceil(delta * m_IterationsPerSecond);
-    for (int i = 0; i < iterations; i++) {
-        DoIteration();
-        m_IterationCounter += 1;
-    }
-}
-
-void IterationController::DoIteration() {
-    BoardState original = m_RenderBoard;
-    //m_RenderBoard.Clear();
-
-    for (int y = 0; y < m_RenderBoard.GetHeight(); y++) {
-        for (int x = 0; x < m_RenderBoard.GetWidth(); x++) {
-            int neighbors = original.CountNeighbors(x, y);
-            if (original.GetCellState(x, y)) {
-                if (neighbors < 2) {
-                    m_RenderBoard.SetCellState(x, y, false);
-                }
-                if (neighbors > 3) {
-                    m_RenderBoard.SetCellState(x, y, false);
-                }
-            } else {
-                if (neighbors == 3) {
-                    m_RenderBoard.SetCellState(x, y, true);
-                }
+
+    for (size_t ty = 0; ty < rows; ty++) {
+        for (size_t tx = 0; tx < columns; tx++)
+            m_DirtyTiles[ty * columns + tx] |= board.IsTileChanged(tx, ty) ? 1 : 0;
+    }
+}
+
+void IterationController::DetectCycle() {
+    bool found = m_CycleDetector.Update(GetBoard(), m_IterationCounter);
+    m_BoardHash = m_CycleDetector.GetHash();
+    m_CyclePeriod = m_CycleDetector.GetPeriod();
+    m_CycleOnsetGeneration = m_CycleDetector.GetOnsetGeneration();
+
+    // Only when first found, so that resuming afterwards keeps running
+    if (found && m_IsPauseOnCycle)
+        Pause();
+}
+
+// Edits don't say what they changed, so the population is counted from scratch
+void IterationController::RecountPopulation() {
+    m_Population = GetBoard().CountPopulation();
+    m_IsPopulationStale = false;
+
+    std::lock_guard<std::mutex> lock(m_StatsMutex);
+    m_Stats = { m_IterationCounter, m_Population, 0, 0 };
+}
+
+void IterationController::RecordStats(uint64_t births, uint64_t deaths) {
+    m_Population += births - deaths;
+
+    std::lock_guard<std::mutex> lock(m_StatsMutex);
+    m_Stats = { m_IterationCounter, m_Population, births, deaths };
+    m_PopulationHistory[m_PopulationHistoryNext] = float(m_Population);
+    m_PopulationHistoryNext = (m_PopulationHistoryNext + 1) % PopulationHistoryLength;
+    m_PopulationHistoryCount = std::min(m_PopulationHistoryCount + 1, PopulationHistoryLength);
+}
+
+void IterationController::RecordTimeline(const BoardState* previous) {
+    size_t budget = m_TimelineBudget;
+    if (budget == 0) {
+        if (!m_Timeline.IsEmpty())
+            m_Timeline.Clear();
+    } else {
+        m_Timeline.SetBudget(budget);
+        m_Timeline.SetKeyframeInterval(m_KeyframeInterval);
+        m_Timeline.Record(GetBoard(), previous, m_IterationCounter);
+    }
+
+    m_TimelineOldest = m_Timeline.GetOldestGeneration();
+    m_TimelineNewest = m_Timeline.GetNewestGeneration();
+    m_TimelineFrames = m_Timeline.GetFrameCount();
+    m_TimelineBytes = m_Timeline.GetByteCount();
+}
+
+void IterationController::RewindTo(long long generation) {
+    SubmitEdit([this, generation](BoardState& board) {
+        long long restored = m_Timeline.Restore(generation, board);
+        if (restored >= 0)
+            m_IterationCounter = restored;
+    });
+}
+
+GenerationStats IterationController::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_StatsMutex);
+    return m_Stats;
+}
+
+// Births and deaths between two boards, only looking at the tiles flagged as changed in the later one
+static void CountChangedTiles(const BoardState& before, const BoardState& after, uint64_t& births, uint64_t& deaths) {
+    for (size_t ty = 0; ty < after.GetTileRows(); ty++) {
+        size_t yEnd = std::min(after.GetHeight(), (ty + 1) * TileSize);
+        for (size_t tx = 0; tx < after.GetTileColumns(); tx++) {
+            if (!after.IsTileChanged(tx, ty))
+                continue;
+            for (size_t y = ty * TileSize; y < yEnd; y++) {
+                CellWord current = before.GetRow(y)[tx];
+                CellWord next = after.GetRow(y)[tx];
+                births += CountCells(next & ~current);
+                deaths += CountCells(current & ~next);
             }
         }
     }
 }
 
-void IterationController::RenderImgui() {
-    if (ImGui::CollapsingHeader("Iteration options")) {
-        if (m_IsPaused)
-            ImGui::TextColored(ImVec4(1, 0, 0, 1), "Iteration Paused");
-        else
-            ImGui::TextColored(ImVec4(0, 1, 0, 1), "Iteration Running");
+void IterationController::PublishSnapshot() {
+    if (m_DirtyTiles.size() != GetBoard().GetTileColumns() * GetBoard().GetTileRows())
+        AccumulateDirtyTiles(GetBoard());
 
-        if (ImGui::Button("|| Pause")) Pause();
-        ImGui::SameLine();
-        if (ImGui::Button("> Resume")) Resume();
+    m_SnapshotSerial++;
+    for (size_t i = 0; i < m_DirtyTiles.size(); i++) {
+        if (m_DirtyTiles[i])
+            m_TileSerials[i] = m_SnapshotSerial;
+        m_DirtyTiles[i] = 0;
+    }
 
-        ImGui::Spacing();
-        ImGui::Spacing();
-        ImGui::Text("%" PRId64 " iterations total", m_IterationCounter);
-        if (m_IsPaused) {
-            if (ImGui::Button("Reset iteration count")) {
-                ResetIterationCounter();
-            }
-            ImGui::Spacing();
-            ImGui::Spacing();
+    BoardSnapshot& snapshot = m_Snapshots.GetWriteSlot();
+    snapshot.Board = GetBoard();
+    snapshot.Generation = m_IterationCounter;
+    snapshot.Serial = m_SnapshotSerial;
+    snapshot.TileSerials = m_TileSerials;
+    m_Snapshots.Publish();
+    m_PublishedBoardSize = PackBoardSize(GetBoard().GetWidth(), GetBoard().GetHeight());
+}
 
-            ImGui::InputInt("Iterations per second", &m_IterationsPerSecond);
+const BoardState& IterationController::AcquireRenderBoard() {
+    if (!m_Thread.joinable()) {
+        m_RenderGeneration = m_IterationCounter;
+        return GetBoard();
+    }
+    m_Snapshots.Consume();
+    m_RenderGeneration = m_Snapshots.GetReadSlot().Generation;
+    return m_Snapshots.GetReadSlot().Board;
+}
 
-        } else {
-            ImGui::Spacing();
-            ImGui::Spacing();
-            ImGui::Text("More options are available when the iteration is paused");
+const BoardSnapshot& IterationController::AcquireRenderSnapshot() {
+    if (!m_Thread.joinable())
+        PublishSnapshot();
+    m_Snapshots.Consume();
+    m_RenderGeneration = m_Snapshots.GetReadSlot().Generation;
+    return m_Snapshots.GetReadSlot();
+}
+
+void IterationController::SubmitEdit(BoardEdit edit) {
+    if (!m_Thread.joinable()) {
+        edit(GetMutBoard());
+        AccumulateDirtyTiles(GetBoard());
+        DetectCycle();
+        RecountPopulation();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_EditMutex);
+        m_PendingEdits.push_back(std::move(edit));
+    }
+    m_EditCondition.notify_one();
+}
+
+int IterationController::Process(float delta) {
+    if (m_IsPaused) {
+        m_TimeAccumulator = 0;
+        m_MeasuredIterationsPerSecond = 0;
+        m_RateIterations = 0;
+        m_RateTimer = std::chrono::steady_clock::now();
+        return 0;
+    }
+
+    int iterations = 0;
+    long long generations = 0;
+    if (m_IsMaxSpeed) {
+        // Keep stepping until the budget is spent, then give the renderer a new snapshot
+        auto budget = std::chrono::duration<float, std::milli>(m_MaxSpeedBudgetMillis.load());
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget);
+        do {
+            generations += DoIteration();
+            iterations++;
+        } while (std::chrono::steady_clock::now() < deadline && !m_IsPaused);
+        m_TimeAccumulator = 0;
+    } else {
+        // Fixed timestep. The backlog is capped, so that one slow generation
+        // doesn't make every following tick try to catch up.
+        double step = 1.0 / m_IterationsPerSecond;
+        m_TimeAccumulator = std::min(m_TimeAccumulator + delta, std::max(step, MaxCatchUpSeconds));
+        while (m_TimeAccumulator >= step && !m_IsPaused) {
+            generations += DoIteration();
+            iterations++;
+            m_TimeAccumulator -= step;
         }
     }
+
+    m_RateIterations += generations;
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - m_RateTimer).count();
+    if (elapsed >= RateWindowSeconds) {
+        m_MeasuredIterationsPerSecond = double(m_RateIterations) / elapsed;
+        m_RateIterations = 0;
+        m_RateTimer = now;
+    }
+
+    return iterations;
+}
+
+double IterationController::GetSecondsUntilNextIteration() const {
+    if (m_IsMaxSpeed)
+        return 0;
+    return 1.0 / m_IterationsPerSecond - m_TimeAccumulator;
+}
+
+long long IterationController::DoIteration() {
+    uint64_t allocatedBefore = g_BoardAllocatedBytes;
+
+    BoardState& front = m_Boards[m_FrontBoard];
+    BoardState& back = m_Boards[1 - m_FrontBoard];
+    if (back.GetWidth() != front.GetWidth() || back.GetHeight() != front.GetHeight()) {
+        back = BoardState(front.GetWidth(), front.GetHeight());
+        // The new back board doesn't hold the previous generation, so nothing can be skipped
+        front.MarkAllTilesChanged();
+    }
+
+    // Tiles that didn't change can only be skipped if the back board was stepped under the same rule.
+    // Earlier generations also don't say anything about cycles under another rule or engine.
+    Rule rule = m_Rule;
+    if (rule != m_SteppedRule) {
+        front.MarkAllTilesChanged();
+        m_SteppedRule = rule;
+        m_CycleDetector.Reset();
+    }
+
+    IterationEngine engine = m_Engine;
+    if ((engine == IterationEngine::HashLife && !HashLife::SupportsRule(rule))
+        || (engine == IterationEngine::SparsePlane && !SparsePlane::SupportsRule(rule)))
+        engine = IterationEngine::Board;
+    if (engine != m_SteppedEngine) {
+        m_SteppedEngine = engine;
+        m_CycleDetector.Reset();
+    }
+
+    // Boards from before a switch to or from a Generations rule, or loaded by an edit,
+    // may not have the age planes the rule needs
+    if (front.GetAgePlaneCount() != rule.GetAgePlaneCount())
+        front.SetAgePlaneCount(rule.GetAgePlaneCount());
+    if (back.GetAgePlaneCount() != rule.GetAgePlaneCount()) {
+        back.SetAgePlaneCount(rule.GetAgePlaneCount());
+        front.MarkAllTilesChanged();
+    }
+
+    // The generation being stepped from starts the detector's history over, and is
+    // the population's starting point, after the board was modified directly
+    if (m_CycleDetector.IsStale())
+        DetectCycle();
+    if (m_IsPopulationStale)
+        RecountPopulation();
+    if (m_Timeline.IsBroken())
+        RecordTimeline(nullptr);
+
+    long long generations = 1;
+    uint64_t births = 0;
+    uint64_t deaths = 0;
+    if (engine == IterationEngine::HashLife) {
+        generations = StepHashLife(front, back, rule);
+        CountChangedTiles(front, back, births, deaths);
+        m_IsSparsePlaneStale = true;
+    } else if (engine == IterationEngine::SparsePlane) {
+        StepSparsePlane(front, back, rule);
+        CountChangedTiles(front, back, births, deaths);
+        m_IsHashLifeStale = true;
+    } else {
+        StepBands(front, back, rule, births, deaths);
+        // The infinite planes didn't follow along
+        m_IsHashLifeStale = true;
+        m_IsSparsePlaneStale = true;
+    }
+
+    m_FrontBoard = 1 - m_FrontBoard;
+    m_IterationCounter += generations;
+    AccumulateDirtyTiles(m_Boards[m_FrontBoard]);
+    DetectCycle();
+    RecordStats(births, deaths);
+    // The back board now holds the generation before
+    RecordTimeline(&m_Boards[1 - m_FrontBoard]);
+
+    m_LastIterationAllocatedBytes = g_BoardAllocatedBytes - allocatedBefore;
+    return generations;
+}
+
+void IterationController::StepBands(const BoardState& front, BoardState& back, const Rule& rule, uint64_t& births, uint64_t& deaths) {
+    m_WorkerPool.SetThreadCount(m_RequestedThreadCount);
+
+    // Bands are made of whole tile rows, so every tile's changed flag is written by one thread
+    size_t tileRows = front.GetTileRows();
+    size_t bands = std::min(m_WorkerPool.GetThreadCount(), tileRows);
+    if (m_BandScratch.size() < bands)
+        m_BandScratch.resize(bands);
+
+    // The bands write rows in parallel, so the back board is invalidated once up front
+    back.InvalidateDensityPyramid();
+
+    auto stepBand = [&](size_t band) {
+        StepScratch& scratch = m_BandScratch[band];
+        scratch.Prepare(front);
+        StepTileRows(front, back, tileRows * band / bands, tileRows * (band + 1) / bands, scratch, rule);
+    };
+    m_WorkerPool.Run(bands, stepBand);
+
+    size_t activeTiles = 0;
+    for (size_t band = 0; band < bands; band++) {
+        activeTiles += m_BandScratch[band].ActiveTileCount;
+        births += m_BandScratch[band].Births;
+        deaths += m_BandScratch[band].Deaths;
+    }
+    m_ActiveTileRatio = double(activeTiles) / double(tileRows * front.GetTileColumns());
+}
+
+long long IterationController::StepHashLife(const BoardState& front, BoardState& back, const Rule& rule) {
+    if (!m_HashLife)
+        m_HashLife = std::make_unique<HashLife>();
+    m_HashLife->SetRule(rule);
+
+    // The universe is only rebuilt from the board after edits, so that cells which
+    // left the board's window keep existing on the plane
+    if (m_IsHashLifeStale) {
+        m_HashLife->Import(front);
+        m_IsHashLifeStale = false;
+    }
+
+    int log2Generations = m_HashLifeStepLog2;
+    m_HashLife->Step(log2Generations);
+    m_HashLife->Export(back, &front);
+    m_HashLifeNodeCount = m_HashLife->GetNodeCount();
+    return 1LL << log2Generations;
+}
+
+void IterationController::StepSparsePlane(const BoardState& front, BoardState& back, const Rule& rule) {
+    if (!m_SparsePlane)
+        m_SparsePlane = std::make_unique<SparsePlane>();
+    m_SparsePlane->SetRule(rule);
+
+    // Same as with HashLife, cells that left the board's window keep existing on the plane
+    if (m_IsSparsePlaneStale) {
+        m_SparsePlane->Import(front);
+        m_IsSparsePlaneStale = false;
+    }
+
+    m_WorkerPool.SetThreadCount(m_RequestedThreadCount);
+    m_SparsePlane->Step(m_WorkerPool);
+    m_SparsePlane->Export(back);
+
+    m_SparsePlaneTileCount = m_SparsePlane->GetTileCount();
+    m_SparsePlaneSteppedTiles = m_SparsePlane->GetLastSteppedTileCount();
+    m_SparsePlaneBytes = m_SparsePlane->GetAllocatedBytes();
 }
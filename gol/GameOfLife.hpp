@@ -1,9 +1,22 @@
 #pragma once
 
-#include "Common.hpp"
+#include "BoardState.hpp"
+#include "CycleDetector.hpp"
+#include "HashLife.hpp"
+#include "SparsePlane.hpp"
+#include "StepKernel.hpp"
+#include "Timeline.hpp"
+#include "TripleBuffer.hpp"
+#include "WorkerPool.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 #include <glm/glm.hpp>
@@ -11,139 +24,286 @@
 
 #include <iostream>
 
-typedef int CellType;
+struct BoardSnapshot {
+    BoardState Board;
+    long long Generation{ 0 };
 
-class BoardState {
-public:
-    BoardState(size_t w, size_t h)
-        : m_States(w * h)
-        , m_Width(w)
-        , m_Height(h) {}
+    // Snapshots are numbered as they're published, and each tile holds the number of the
+    // last snapshot that changed it. A reader that skipped some snapshots can still tell
+    // which tiles changed since the one it saw last.
+    uint64_t Serial{ 0 };
+    std::vector<uint64_t> TileSerials{};
+};
 
-    static BoardState GenerateTestBoard() {
-        BoardState result(100, 100);
+// Live cells of a generation, and the cells that came alive or stopped being alive since the
+// previous iteration. Under Generations rules only cells in the alive state count as live.
+struct GenerationStats {
+    long long Generation{ 0 };
+    uint64_t Population{ 0 };
+    uint64_t Births{ 0 };
+    uint64_t Deaths{ 0 };
+};
 
-        for (size_t x = 0; x < result.GetWidth(); x++) {
-            result.SetCellState(x, 0, true);
-            result.SetCellState(x, result.GetHeight() - 1, true);
-        }
+enum class IterationEngine {
+    // Steps every cell of the torus each generation
+    Board,
+    // Advances the board's window on an infinite plane by 2^k generations per iteration.
+    // Rules with B0 and Generations rules aren't supported, under them the board is stepped instead.
+    HashLife,
+    // Steps the board's window on an infinite plane of hashed tiles, one generation per iteration.
+    // Rules with B0 aren't supported, under them the board is stepped instead.
+    SparsePlane,
+};
 
-        for (size_t y = 1; y < result.GetHeight() - 1; y++) {
-            result.SetCellState(0, y, true);
-            result.SetCellState(result.GetWidth() - 1, y, true);
-        }
+// Modification of the board, queued by the render thread and applied by the simulation thread
+typedef std::function<void(BoardState&)> BoardEdit;
 
-        return result;
-    }
+class IterationController {
+public:
+    // HashLife generation counts are kept well inside the iteration counter's range
+    static constexpr int MaxHashLifeStepLog2 = 40;
 
-    bool IsInBounds(size_t x, size_t y) const {
-        return x < m_Width && y < m_Height;
+    IterationController(size_t boardWidth, size_t boardHeight)
+        : m_Boards{ BoardState(boardWidth, boardHeight), BoardState(boardWidth, boardHeight) }
+        , m_Snapshots(BoardSnapshot{ BoardState(boardWidth, boardHeight) })
+        , m_PublishedBoardSize(PackBoardSize(boardWidth, boardHeight)) {
+        SetThreadCount(std::thread::hardware_concurrency());
     }
 
-    bool GetCellState(int x, int y) const {
-        x = ClampX(x);
-        y = ClampY(y);
-        return m_States[y * m_Width + x] != 0;
-    }
+    ~IterationController() { StopThread(); }
 
-    void SetCellState(int x, int y, bool state) {
-        x = ClampX(x);
-        y = ClampY(y);
-        m_States[y * m_Width + x] = state ? 1 : 0;
-    }
+    // Runs the simulation on its own thread until StopThread is called.
+    // While it runs, the board may only be read through AcquireRenderBoard
+    // and modified through SubmitEdit.
+    void StartThread();
+    void StopThread();
 
-    size_t GetWidth() const {
-        return m_Width;
+    void Pause() { m_IsPaused = true; }
+    // Changed under the edit mutex, so that the wakeup can't slip in between the simulation
+    // thread checking whether it's paused and going to sleep
+    void Resume() {
+        {
+            std::lock_guard<std::mutex> lock(m_EditMutex);
+            m_IsPaused = false;
+        }
+        m_EditCondition.notify_one();
     }
 
-    size_t GetHeight() const {
-        return m_Height;
-    }
+    // Runs as many iterations as are due after delta seconds, returns how many were run.
+    // In max speed mode it instead steps for the configured time budget.
+    int Process(float delta);
 
-    size_t ClampX(int x) const {
-        if (x < 0) return m_Width + x;
-        if (x >= m_Width) return x - m_Width;
-        return x;
-    }
+    // Runs a single iteration and advances the iteration counter, returns the number of generations it advanced
+    long long DoIteration();
 
-    size_t ClampY(int y) const {
-        if (y < 0) return m_Height + y;
-        if (y >= m_Height) return y - m_Height;
-        return y;
+    // Direct access to the current generation, for use when no simulation thread is running
+    const BoardState& GetBoard() const { return m_Boards[m_FrontBoard]; }
+    BoardState& GetMutBoard() {
+        m_IsHashLifeStale = true;
+        m_IsSparsePlaneStale = true;
+        m_CycleDetector.Reset();
+        m_IsPopulationStale = true;
+        m_Timeline.Break();
+        return m_Boards[m_FrontBoard];
     }
 
-    void SetCellLine(int x1, int y1, int x2, int y2, bool state) {
-        x1 = ClampX(x1);
-        x2 = ClampX(x2);
-        y1 = ClampY(y1);
-        y2 = ClampY(y2);
-
-        glm::vec2 start(x1, y1);
-        glm::vec2 end(x2, y2);
-        glm::vec2 direction = glm::normalize(end - start);
-        float length = glm::length(end - start);
-        float travelled = 0;
-        
-        glm::vec2 current = start;
-        while (travelled <= length) {
-            SetCellState(current.x, current.y, state);
-            current += direction;
-            travelled += 1;
-        }
-    }
+    // Latest generation published by the simulation thread. Only to be called from one thread.
+    const BoardState& AcquireRenderBoard();
+
+    // Same as AcquireRenderBoard, along with what changed since earlier snapshots.
+    // Without a simulation thread running, this publishes a copy of the board first.
+    const BoardSnapshot& AcquireRenderSnapshot();
+
+    // Generation counter of the board last returned by AcquireRenderBoard
+    long long GetRenderGeneration() const { return m_RenderGeneration; }
+
+    // Queues an edit to be applied before the next generation
+    void SubmitEdit(BoardEdit edit);
+
+    // Size of the board as of the last published snapshot, safe to read from any thread. The two
+    // are read apart, so right after a resize they can disagree, a snapshot's board can't.
+    int GetBoardWidth() const { return int(m_PublishedBoardSize >> 32); }
+    int GetBoardHeight() const { return int(m_PublishedBoardSize & 0xFFFFFFFF); }
+    bool IsPaused() const { return m_IsPaused; }
 
-    void Clear() {
-        for (int i = 0; i < m_States.size(); i++)
-            m_States[i] = 0;
+    long long GetIterationCounter() const { return m_IterationCounter; }
+    void ResetIterationCounter() {
+        m_IterationCounter = 0;
     }
 
-    int CountNeighbors(int x, int y) {
-        int neighbors = 0;
-        neighbors += GetCellState(x - 1, y - 1) ? 1 : 0;
-        neighbors += GetCellState(x + 0, y - 1) ? 1 : 0;
-        neighbors += GetCellState(x + 1, y - 1) ? 1 : 0;
-        neighbors += GetCellState(x - 1, y + 0) ? 1 : 0;
-        neighbors += GetCellState(x + 1, y + 0) ? 1 : 0;
-        neighbors += GetCellState(x - 1, y + 1) ? 1 : 0;
-        neighbors += GetCellState(x + 0, y + 1) ? 1 : 0;
-        neighbors += GetCellState(x + 1, y + 1) ? 1 : 0;
-        return neighbors;
+    // For restoring a checkpoint, from an edit or while no simulation thread is running
+    void SetIterationCounter(long long generation) {
+        m_IterationCounter = generation;
     }
 
-private:
-    size_t m_Width;
-    size_t m_Height;
-    std::vector<CellType> m_States;
-};
+    uint64_t GetLastIterationAllocatedBytes() const { return m_LastIterationAllocatedBytes; }
+    double GetMeasuredIterationsPerSecond() const { return m_MeasuredIterationsPerSecond; }
 
-class IterationController {
-public:
-    IterationController(size_t boardWidth, size_t boardHeight)
-        : m_RenderBoard(boardWidth, boardHeight){}
+    // Fraction of the board's tiles the last iteration had to recompute
+    double GetActiveTileRatio() const { return m_ActiveTileRatio; }
 
-    void Pause() { m_IsPaused = true; }
-    void Resume() { m_IsPaused = false; }
+    int GetIterationsPerSecond() const { return m_IterationsPerSecond; }
+    void SetIterationsPerSecond(int rate) { m_IterationsPerSecond = std::max(1, rate); }
 
-    void Process(float delta);
-    void DoIteration();
+    IterationEngine GetEngine() const { return m_Engine; }
+    void SetEngine(IterationEngine engine) { m_Engine = engine; }
 
-    const BoardState& GetRenderBoard() { return m_RenderBoard; };
-    BoardState& GetMutRenderBoard() { return m_RenderBoard; };
+    // The rule change is picked up before the next iteration
+    Rule GetRule() const { return m_Rule; }
+    void SetRule(const Rule& rule) { m_Rule = rule; }
 
-    int GetBoardWidth() const { return m_RenderBoard.GetWidth(); }
-    int GetBoardHeight() const { return m_RenderBoard.GetHeight(); }
-    bool IsPaused() const { return m_IsPaused; }
+    // Tiles of the sparse plane after the last iteration that ran on it, and the bytes they take
+    size_t GetSparsePlaneTileCount() const { return m_SparsePlaneTileCount; }
+    size_t GetSparsePlaneBytes() const { return m_SparsePlaneBytes; }
 
-    long long GetIterationCounter() const { return m_IterationCounter; }
-    void ResetIterationCounter() {
-        m_IterationCounter = 0;
-    }
+    // Stats of the current generation. The stepped board gets births and deaths from the step kernel,
+    // the infinite planes from comparing the board's changed tiles, and the population is kept up to
+    // date from them, only recounted after edits. HashLife's births and deaths are net counts over
+    // the generations of an iteration.
+    GenerationStats GetStats() const;
+
+    // Population after each of the last PopulationHistoryLength iterations
+    static constexpr size_t PopulationHistoryLength = 512;
+
+    // Given a memory budget, every iteration is recorded into a timeline for rewinding. It's off by
+    // default, as encoding each generation's changes costs about as much as stepping a busy board.
+    // Rewinding is queued like an edit, and goes to the last recorded generation at or before the
+    // given one. Generations after it stay available until the next iteration.
+    void RewindTo(long long generation);
+    long long GetTimelineOldestGeneration() const { return m_TimelineOldest; }
+    long long GetTimelineNewestGeneration() const { return m_TimelineNewest; }
+    size_t GetTimelineFrameCount() const { return m_TimelineFrames; }
+    size_t GetTimelineBytes() const { return m_TimelineBytes; }
+    size_t GetTimelineBudget() const { return m_TimelineBudget; }
+    void SetTimelineBudget(size_t bytes) { m_TimelineBudget = bytes; }
+    long long GetKeyframeInterval() const { return m_KeyframeInterval; }
+    void SetKeyframeInterval(long long generations) { m_KeyframeInterval = std::max(1LL, generations); }
+
+    // Hash of the current generation and the cycle the board settled into, if any. Found by comparing
+    // the hashes of the last CycleDetector::HistoryLength iterations, and forgotten on edits, rule or
+    // engine changes. On the infinite planes only the board's window is compared.
+    uint64_t GetBoardHash() const { return m_BoardHash; }
+    long long GetCyclePeriod() const { return m_CyclePeriod; }
+    long long GetCycleOnsetGeneration() const { return m_CycleOnsetGeneration; }
+
+    // Pauses the simulation thread once a cycle is found
+    bool IsPauseOnCycle() const { return m_IsPauseOnCycle; }
+    void SetPauseOnCycle(bool pause) { m_IsPauseOnCycle = pause; }
+
+    int GetHashLifeStepLog2() const { return m_HashLifeStepLog2; }
+    void SetHashLifeStepLog2(int log2Generations) { m_HashLifeStepLog2 = std::clamp(log2Generations, 0, MaxHashLifeStepLog2); }
+
+    bool IsMaxSpeed() const { return m_IsMaxSpeed; }
+    void SetMaxSpeed(bool maxSpeed) { m_IsMaxSpeed = maxSpeed; }
+
+    // The thread count change is picked up before the next iteration
+    size_t GetThreadCount() const { return m_RequestedThreadCount; }
+    void SetThreadCount(size_t count) { m_RequestedThreadCount = std::max<size_t>(1, count); }
 
     void RenderImgui();
 
 private:
-    BoardState m_RenderBoard;
-    bool m_IsPaused{ false };
-    long long m_IterationCounter{ 0 };
-    int m_IterationsPerSecond{ 10 };
+    static uint64_t PackBoardSize(size_t width, size_t height) { return (uint64_t(width) << 32) | uint64_t(height); }
+
+    void ThreadMain();
+    void StepBands(const BoardState& front, BoardState& back, const Rule& rule, uint64_t& births, uint64_t& deaths);
+    long long StepHashLife(const BoardState& front, BoardState& back, const Rule& rule);
+    void StepSparsePlane(const BoardState& front, BoardState& back, const Rule& rule);
+    double GetSecondsUntilNextIteration() const;
+    bool ApplyEdits();
+    void PublishSnapshot();
+    void AccumulateDirtyTiles(const BoardState& board);
+    void DetectCycle();
+    void RecountPopulation();
+    void RecordStats(uint64_t births, uint64_t deaths);
+    void RecordTimeline(const BoardState* previous);
+
+    // The front board is the current generation, the back one receives the next
+    // generation and gets swapped in afterwards, so no copies are made per iteration.
+    BoardState m_Boards[2];
+    int m_FrontBoard{ 0 };
+
+    // The board is split into horizontal bands, each stepped by one thread with its own scratch
+    WorkerPool m_WorkerPool{};
+    std::vector<StepScratch> m_BandScratch{};
+    std::atomic<size_t> m_RequestedThreadCount{ 1 };
+    std::atomic<double> m_ActiveTileRatio{ 1 };
+
+    // The rule the back board was last stepped with, only touched by the simulation thread
+    std::atomic<Rule> m_Rule{ Rule() };
+    Rule m_SteppedRule{};
+
+    // The engine that last stepped the board, falling back to Board for unsupported rules
+    std::atomic<IterationEngine> m_Engine{ IterationEngine::Board };
+    IterationEngine m_SteppedEngine{ IterationEngine::Board };
+    std::unique_ptr<HashLife> m_HashLife{};
+    bool m_IsHashLifeStale{ true };
+    std::atomic<int> m_HashLifeStepLog2{ 0 };
+    std::atomic<size_t> m_HashLifeNodeCount{ 0 };
+
+    std::unique_ptr<SparsePlane> m_SparsePlane{};
+    bool m_IsSparsePlaneStale{ true };
+    std::atomic<size_t> m_SparsePlaneTileCount{ 0 };
+    std::atomic<size_t> m_SparsePlaneSteppedTiles{ 0 };
+    std::atomic<size_t> m_SparsePlaneBytes{ 0 };
+
+    // Population of the current generation, only touched by the simulation thread.
+    // The stats and history are published under the mutex.
+    uint64_t m_Population{ 0 };
+    bool m_IsPopulationStale{ true };
+    mutable std::mutex m_StatsMutex{};
+    GenerationStats m_Stats{};
+    float m_PopulationHistory[PopulationHistoryLength]{};
+    size_t m_PopulationHistoryCount{ 0 };
+    size_t m_PopulationHistoryNext{ 0 };
+
+    // Only touched by the simulation thread, and by the edits rewinding it
+    Timeline m_Timeline{};
+    std::atomic<size_t> m_TimelineBudget{ 0 };
+    std::atomic<long long> m_KeyframeInterval{ 64 };
+    std::atomic<long long> m_TimelineOldest{ 0 };
+    std::atomic<long long> m_TimelineNewest{ 0 };
+    std::atomic<size_t> m_TimelineFrames{ 0 };
+    std::atomic<size_t> m_TimelineBytes{ 0 };
+
+    // Only touched by the simulation thread, its findings are published below
+    CycleDetector m_CycleDetector{};
+    std::atomic<uint64_t> m_BoardHash{ 0 };
+    std::atomic<long long> m_CyclePeriod{ 0 };
+    std::atomic<long long> m_CycleOnsetGeneration{ 0 };
+    std::atomic<bool> m_IsPauseOnCycle{ false };
+
+    std::thread m_Thread{};
+    std::atomic<bool> m_IsThreadStopping{ false };
+    TripleBuffer<BoardSnapshot> m_Snapshots;
+    // Width in the high half, height in the low one
+    std::atomic<uint64_t> m_PublishedBoardSize;
+    long long m_RenderGeneration{ 0 };
+
+    // Tiles changed by generations or edits since the last snapshot was published, and the
+    // serial of the last snapshot that changed each tile
+    std::vector<uint8_t> m_DirtyTiles{};
+    std::vector<uint64_t> m_TileSerials{};
+    uint64_t m_SnapshotSerial{ 0 };
+
+    std::mutex m_EditMutex{};
+    std::condition_variable m_EditCondition{};
+    std::vector<BoardEdit> m_PendingEdits{};
+    std::vector<BoardEdit> m_ApplyingEdits{};
+
+    std::atomic<uint64_t> m_LastIterationAllocatedBytes{ 0 };
+    std::atomic<bool> m_IsPaused{ false };
+    std::atomic<long long> m_IterationCounter{ 0 };
+    std::atomic<int> m_IterationsPerSecond{ 10 };
+    std::atomic<bool> m_IsMaxSpeed{ false };
+    std::atomic<float> m_MaxSpeedBudgetMillis{ 16 };
+
+    // Rule editor state of the ImGui window
+    char m_RuleText[64]{ "B3/S23" };
+    std::string m_RuleError{};
+
+    double m_TimeAccumulator{ 0 };
+    std::chrono::steady_clock::time_point m_RateTimer{ std::chrono::steady_clock::now() };
+    long long m_RateIterations{ 0 };
+    std::atomic<double> m_MeasuredIterationsPerSecond{ 0 };
 };
@@ -0,0 +1,161 @@
+#include "GameOfLife.hpp"
+#include <imgui.h>
+#include <cinttypes>
+#include <algorithm>
+#include <cfloat>
+
+// The ImGui window lives apart from the rest of IterationController,
+// so that the engine can be built without ImGui (see the headless runner)
+
+void IterationController::RenderImgui() {
+    if (ImGui::CollapsingHeader("Iteration options")) {
+        if (m_IsPaused)
+            ImGui::TextColored(ImVec4(1, 0, 0, 1), "Iteration Paused");
+        else
+            ImGui::TextColored(ImVec4(0, 1, 0, 1), "Iteration Running");
+
+        if (ImGui::Button("|| Pause")) Pause();
+        ImGui::SameLine();
+        if (ImGui::Button("> Resume")) Resume();
+
+        ImGui::Spacing();
+        ImGui::Spacing();
+        ImGui::Text("Rule: %s", GetRule().ToString().c_str());
+        ImGui::Text("%lld iterations total", GetIterationCounter());
+        double measuredRate = GetMeasuredIterationsPerSecond();
+        ImGui::Text("%.1f generations/s, %.3g cells/s", measuredRate, measuredRate * GetBoardWidth() * GetBoardHeight());
+
+        GenerationStats stats = GetStats();
+        ImGui::Text("Population %" PRIu64 ", %" PRIu64 " births and %" PRIu64 " deaths by the last iteration",
+            stats.Population, stats.Births, stats.Deaths);
+        {
+            // Once the ring is full, its oldest value is the next one to be overwritten
+            std::lock_guard<std::mutex> lock(m_StatsMutex);
+            size_t oldest = m_PopulationHistoryCount == PopulationHistoryLength ? m_PopulationHistoryNext : 0;
+            ImGui::PlotLines("Population", m_PopulationHistory, int(m_PopulationHistoryCount), int(oldest),
+                nullptr, FLT_MAX, FLT_MAX, ImVec2(0, 80));
+        }
+
+        if (GetEngine() == IterationEngine::Board) {
+            ImGui::Text("%.1f%% of tiles recomputed by the last iteration", GetActiveTileRatio() * 100.0);
+            ImGui::Text("Step kernel: %s", GetKernelLevelName(GetKernelLevel()));
+        }
+        if (GetEngine() == IterationEngine::HashLife) {
+            ImGui::Text("HashLife: %lld generations per iteration, %zu nodes",
+                1LL << m_HashLifeStepLog2, size_t(m_HashLifeNodeCount));
+        }
+        if (GetEngine() == IterationEngine::SparsePlane) {
+            ImGui::Text("Sparse plane: %zu tiles, %zu stepped by the last iteration, %.1f MiB",
+                size_t(m_SparsePlaneTileCount), size_t(m_SparsePlaneSteppedTiles), m_SparsePlaneBytes / (1024.0 * 1024.0));
+        }
+        ImGui::Text("%" PRIu64 " bytes allocated by the last iteration", GetLastIterationAllocatedBytes());
+
+        if (GetTimelineFrameCount() > 0) {
+            ImGui::Text("History: generations %lld to %lld, %zu frames in %.1f MiB", GetTimelineOldestGeneration(),
+                GetTimelineNewestGeneration(), GetTimelineFrameCount(), GetTimelineBytes() / (1024.0 * 1024.0));
+        }
+
+        ImGui::Text("Board hash: %016" PRIx64, GetBoardHash());
+        if (GetCyclePeriod() > 0)
+            ImGui::Text("Repeats with period %lld since generation %lld", GetCyclePeriod(), GetCycleOnsetGeneration());
+        else
+            ImGui::Text("No repetition within the last %zu iterations", CycleDetector::HistoryLength);
+        bool isPauseOnCycle = m_IsPauseOnCycle;
+        if (ImGui::Checkbox("Pause when the board repeats", &isPauseOnCycle))
+            m_IsPauseOnCycle = isPauseOnCycle;
+
+        if (m_IsPaused) {
+            if (ImGui::Button("Reset iteration count")) {
+                ResetIterationCounter();
+            }
+            ImGui::Spacing();
+            ImGui::Spacing();
+
+            bool isMaxSpeed = m_IsMaxSpeed;
+            if (ImGui::Checkbox("Run as fast as possible", &isMaxSpeed))
+                m_IsMaxSpeed = isMaxSpeed;
+
+            if (isMaxSpeed) {
+                float budget = m_MaxSpeedBudgetMillis;
+                if (ImGui::SliderFloat("Stepping time per snapshot (ms)", &budget, 1, 100))
+                    m_MaxSpeedBudgetMillis = budget;
+            } else {
+                int iterationsPerSecond = m_IterationsPerSecond;
+                if (ImGui::InputInt("Iterations per second", &iterationsPerSecond))
+                    m_IterationsPerSecond = std::max(1, iterationsPerSecond);
+            }
+
+            const char* engineNames[] = { "Board (torus)", "HashLife (infinite plane)", "Sparse tiles (infinite plane)" };
+            int engine = int(GetEngine());
+            if (ImGui::Combo("Engine", &engine, engineNames, IM_ARRAYSIZE(engineNames)))
+                SetEngine(IterationEngine(engine));
+
+            Rule rule = GetRule();
+            std::string ruleNotation = rule.ToString();
+            const char* preview = "Custom";
+            for (size_t i = 0; i < KnownRuleCount; i++) {
+                if (ruleNotation == KnownRules[i].Notation)
+                    preview = KnownRules[i].Name;
+            }
+            if (ImGui::BeginCombo("Rule", preview)) {
+                for (size_t i = 0; i < KnownRuleCount; i++) {
+                    std::string label = std::string(KnownRules[i].Name) + " (" + KnownRules[i].Notation + ")";
+                    if (ImGui::Selectable(label.c_str(), ruleNotation == KnownRules[i].Notation)) {
+                        Rule::Parse(KnownRules[i].Notation, rule, m_RuleError);
+                        SetRule(rule);
+                        m_RuleError.clear();
+                    }
+                }
+                ImGui::EndCombo();
+            }
+
+            ImGui::InputText("B/S/C notation", m_RuleText, sizeof(m_RuleText));
+            ImGui::SameLine();
+            if (ImGui::Button("Apply")) {
+                m_RuleError.clear();
+                if (Rule::Parse(m_RuleText, rule, m_RuleError))
+                    SetRule(rule);
+            }
+            if (!m_RuleError.empty())
+                ImGui::TextColored(ImVec4(1, 0, 0, 1), "%s", m_RuleError.c_str());
+            if (GetEngine() == IterationEngine::HashLife && !HashLife::SupportsRule(rule))
+                ImGui::TextWrapped("HashLife can't run rules with B0 or Generations rules, the board is stepped instead");
+            if (GetEngine() == IterationEngine::SparsePlane && !SparsePlane::SupportsRule(rule))
+                ImGui::TextWrapped("The sparse plane can't run rules with B0, the board is stepped instead");
+
+            if (GetEngine() == IterationEngine::HashLife) {
+                int stepLog2 = m_HashLifeStepLog2;
+                if (ImGui::SliderInt("Step size 2^k", &stepLog2, 0, MaxHashLifeStepLog2))
+                    m_HashLifeStepLog2 = std::clamp(stepLog2, 0, MaxHashLifeStepLog2);
+            }
+
+            // Rewinding replaces the board like an edit, so that it works the same with any engine
+            long long oldest = GetTimelineOldestGeneration();
+            long long newest = GetTimelineNewestGeneration();
+            if (GetTimelineFrameCount() > 0) {
+                long long generation = std::clamp<long long>(GetIterationCounter(), oldest, newest);
+                if (ImGui::SliderScalar("Rewind to generation", ImGuiDataType_S64, &generation, &oldest, &newest))
+                    RewindTo(generation);
+                if (ImGui::Button("< Step back") && GetIterationCounter() > oldest)
+                    RewindTo(GetIterationCounter() - 1);
+            }
+            int budgetMiB = int(GetTimelineBudget() >> 20);
+            if (ImGui::SliderInt("History budget (MiB)", &budgetMiB, 0, 1024))
+                SetTimelineBudget(size_t(budgetMiB) << 20);
+            if (budgetMiB == 0)
+                ImGui::TextWrapped("No history is kept to rewind to, give it a budget to start recording");
+            int keyframeInterval = int(GetKeyframeInterval());
+            if (ImGui::InputInt("Generations between keyframes", &keyframeInterval))
+                SetKeyframeInterval(keyframeInterval);
+
+            int threadCount = int(GetThreadCount());
+            if (ImGui::SliderInt("Threads", &threadCount, 1, int(std::max(1u, std::thread::hardware_concurrency()) * 2)))
+                SetThreadCount(size_t(threadCount));
+
+        } else {
+            ImGui::Spacing();
+            ImGui::Spacing();
+            ImGui::Text("More options are available when the iteration is paused");
+        }
+    }
+}
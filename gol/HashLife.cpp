@@ -0,0 +1,315 @@
+#include "HashLife.hpp"
+
+// Past this many nodes, the ones no longer reachable from the root are freed after a step
+static constexpr size_t MaxNodes = size_t(1) << 22;
+
+// Level at which Build checks a whole 64x64 square for emptiness, one word per row
+static constexpr int WordLevel = 6;
+
+size_t HashLife::NodeKeyHash::operator()(const NodeKey& key) const {
+    uint64_t hash = 0;
+    for (const Node* child : key.Children) {
+        hash ^= uint64_t(reinterpret_cast<uintptr_t>(child));
+        hash *= 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 29;
+    }
+    return size_t(hash);
+}
+
+HashLife::HashLife() {
+    m_Dead.Level = 0;
+    m_Dead.Population = 0;
+    m_Alive.Level = 0;
+    m_Alive.Population = 1;
+    m_Root = GetEmpty(3);
+}
+
+HashLife::~HashLife() {
+    for (auto& entry : m_Nodes)
+        delete entry.second;
+}
+
+HashLife::Node* HashLife::Join(Node* nw, Node* ne, Node* sw, Node* se) {
+    NodeKey key{ { nw, ne, sw, se } };
+    auto found = m_Nodes.find(key);
+    if (found != m_Nodes.end())
+        return found->second;
+
+    Node* node = new Node{ nw, ne, sw, se, nullptr,
+        nw->Population + ne->Population + sw->Population + se->Population,
+        nw->Level + 1, false };
+    m_Nodes.emplace(key, node);
+    return node;
+}
+
+HashLife::Node* HashLife::GetEmpty(int level) {
+    if (m_EmptyNodes.empty())
+        m_EmptyNodes.push_back(&m_Dead);
+    while (int(m_EmptyNodes.size()) <= level) {
+        Node* child = m_EmptyNodes.back();
+        m_EmptyNodes.push_back(Join(child, child, child, child));
+    }
+    return m_EmptyNodes[level];
+}
+
+// Surrounds the node with empty space, doubling its size while keeping it centered
+HashLife::Node* HashLife::Expand(Node* node) {
+    Node* empty = GetEmpty(node->Level - 1);
+    return Join(
+        Join(empty, empty, empty, node->NW),
+        Join(empty, empty, node->NE, empty),
+        Join(empty, node->SW, empty, empty),
+        Join(node->SE, empty, empty, empty)
+    );
+}
+
+HashLife::Node* HashLife::CenteredSubnode(Node* node) {
+    return Join(node->NW->SE, node->NE->SW, node->SW->NE, node->SE->NW);
+}
+
+HashLife::Node* HashLife::CenteredHorizontal(Node* w, Node* e) {
+    return Join(w->NE, e->NW, w->SE, e->SW);
+}
+
+HashLife::Node* HashLife::CenteredVertical(Node* n, Node* s) {
+    return Join(n->SW, n->SE, s->NW, s->NE);
+}
+
+// Advances the center 2x2 cells of a 4x4 node by a single generation
+HashLife::Node* HashLife::BaseCase(Node* node) {
+    const Node* quadrants[2][2] = { { node->NW, node->NE }, { node->SW, node->SE } };
+    bool cells[4][4];
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            const Node* quadrant = quadrants[y / 2][x / 2];
+            const Node* children[2][2] = { { quadrant->NW, quadrant->NE }, { quadrant->SW, quadrant->SE } };
+            cells[y][x] = children[y % 2][x % 2]->Population != 0;
+        }
+    }
+
+    Node* next[2][2];
+    for (int y = 1; y <= 2; y++) {
+        for (int x = 1; x <= 2; x++) {
+            int neighbors = 0;
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    if (dx != 0 || dy != 0)
+                        neighbors += cells[y + dy][x + dx] ? 1 : 0;
+                }
+            }
+            bool alive = m_Rule.GetNext(cells[y][x], neighbors);
+            next[y - 1][x - 1] = alive ? &m_Alive : &m_Dead;
+        }
+    }
+
+    return Join(next[0][0], next[0][1], next[1][0], next[1][1]);
+}
+
+// Returns the center half of the node, advanced by 2^min(log2Generations, level - 2) generations
+HashLife::Node* HashLife::Successor(Node* node, int log2Generations) {
+    if (node->Population == 0)
+        return node->NW;
+    if (node->Result)
+        return node->Result;
+
+    Node* result;
+    if (node->Level == 2) {
+        result = BaseCase(node);
+    } else {
+        Node* n00 = node->NW;
+        Node* n01 = CenteredHorizontal(node->NW, node->NE);
+        Node* n02 = node->NE;
+        Node* n10 = CenteredVertical(node->NW, node->SW);
+        Node* n11 = CenteredSubnode(node);
+        Node* n12 = CenteredVertical(node->NE, node->SE);
+        Node* n20 = node->SW;
+        Node* n21 = CenteredHorizontal(node->SW, node->SE);
+        Node* n22 = node->SE;
+
+        // For a full step both halves advance time, otherwise only the second one does
+        bool isFullStep = log2Generations >= node->Level - 2;
+        auto firstHalf = [&](Node* n) {
+            return isFullStep ? Successor(n, log2Generations) : CenteredSubnode(n);
+        };
+
+        Node* c00 = firstHalf(n00);
+        Node* c01 = firstHalf(n01);
+        Node* c02 = firstHalf(n02);
+        Node* c10 = firstHalf(n10);
+        Node* c11 = firstHalf(n11);
+        Node* c12 = firstHalf(n12);
+        Node* c20 = firstHalf(n20);
+        Node* c21 = firstHalf(n21);
+        Node* c22 = firstHalf(n22);
+
+        result = Join(
+            Successor(Join(c00, c01, c10, c11), log2Generations),
+            Successor(Join(c01, c02, c11, c12), log2Generations),
+            Successor(Join(c10, c11, c20, c21), log2Generations),
+            Successor(Join(c11, c12, c21, c22), log2Generations)
+        );
+    }
+
+    node->Result = result;
+    return result;
+}
+
+// True if all live cells are within the center half of the node
+bool HashLife::IsPadded(Node* node) const {
+    return node->Level >= 2
+        && node->NW->SE->Population + node->NE->SW->Population
+            + node->SW->NE->Population + node->SE->NW->Population == node->Population;
+}
+
+void HashLife::Step(int log2Generations) {
+    // Memoized results are only valid for the step size they were computed with
+    if (log2Generations != m_CachedStepLog2) {
+        ClearResults();
+        m_CachedStepLog2 = log2Generations;
+    }
+
+    // Pad the pattern until it can't reach past the returned center, even at the speed of light
+    Node* root = m_Root;
+    while (root->Level < log2Generations + 2 || !IsPadded(root))
+        root = Expand(root);
+    root = Expand(root);
+
+    m_Root = Successor(root, log2Generations);
+
+    if (m_Nodes.size() > MaxNodes)
+        CollectGarbage();
+}
+
+void HashLife::SetRule(const Rule& rule) {
+    if (rule == m_Rule)
+        return;
+    m_Rule = rule;
+    ClearResults();
+}
+
+uint64_t HashLife::GetPopulation() const {
+    return m_Root->Population;
+}
+
+void HashLife::Import(const BoardState& board) {
+    int level = WordLevel + 1;
+    while ((int64_t(1) << (level - 1)) < int64_t(std::max(board.GetWidth(), board.GetHeight())))
+        level++;
+
+    // The root is centered on the origin, the board's corner
+    int64_t half = int64_t(1) << (level - 1);
+    m_Root = Build(board, level, -half, -half);
+    ClearResults();
+}
+
+HashLife::Node* HashLife::Build(const BoardState& board, int level, int64_t x, int64_t y) {
+    int64_t size = int64_t(1) << level;
+    int64_t width = int64_t(board.GetWidth());
+    int64_t height = int64_t(board.GetHeight());
+    if (x >= width || y >= height || x + size <= 0 || y + size <= 0)
+        return GetEmpty(level);
+
+    if (level == 0)
+        return board.GetCellState(int(x), int(y)) ? &m_Alive : &m_Dead;
+
+    // Squares at this level line up with the board's words, so emptiness can be checked a row at a time
+    if (level == WordLevel && x >= 0 && y >= 0) {
+        bool isEmpty = true;
+        for (int64_t row = y; row < std::min(y + size, height) && isEmpty; row++)
+            isEmpty = board.GetRow(size_t(row))[size_t(x) / CellsPerWord] == 0;
+        if (isEmpty)
+            return GetEmpty(level);
+    }
+
+    int64_t half = size / 2;
+    return Join(
+        Build(board, level - 1, x, y),
+        Build(board, level - 1, x + half, y),
+        Build(board, level - 1, x, y + half),
+        Build(board, level - 1, x + half, y + half)
+    );
+}
+
+void HashLife::Export(BoardState& board, const BoardState* previous) const {
+    const BoardState& reference = previous ? *previous : board;
+    size_t stride = board.GetStride();
+    int64_t half = int64_t(1) << (m_Root->Level - 1);
+    for (size_t ty = 0; ty < board.GetTileRows(); ty++) {
+        size_t rowBegin = ty * TileSize;
+        size_t rows = std::min(TileSize, board.GetHeight() - rowBegin);
+        m_ExportRows.assign(rows * stride, 0);
+        ExportNode(m_Root, -half, -half, int64_t(rowBegin), int64_t(rowBegin + rows), stride);
+
+        for (size_t tx = 0; tx < stride; tx++) {
+            // Cells past the board's right edge still land in the padding of the last word
+            CellWord mask = tx == stride - 1 ? board.GetLastWordMask() : ~CellWord(0);
+            bool isChanged = false;
+            for (size_t r = 0; r < rows; r++) {
+                CellWord& word = m_ExportRows[r * stride + tx];
+                word &= mask;
+                isChanged = isChanged || word != reference.GetRow(rowBegin + r)[tx];
+            }
+            // The board only needs writing where it doesn't hold the reference already
+            if (isChanged || previous) {
+                for (size_t r = 0; r < rows; r++)
+                    board.GetMutRow(rowBegin + r)[tx] = m_ExportRows[r * stride + tx];
+            }
+            board.SetTileChanged(tx, ty, isChanged);
+        }
+    }
+    board.InvalidateDensityPyramid();
+}
+
+// Sets the node's live cells within the rows [rowBegin, rowEnd) in the export rows
+void HashLife::ExportNode(const Node* node, int64_t x, int64_t y, int64_t rowBegin, int64_t rowEnd, size_t stride) const {
+    int64_t size = int64_t(1) << node->Level;
+    if (node->Population == 0)
+        return;
+    if (x >= int64_t(stride * CellsPerWord) || y >= rowEnd || x + size <= 0 || y + size <= rowBegin)
+        return;
+
+    if (node->Level == 0) {
+        m_ExportRows[size_t(y - rowBegin) * stride + size_t(x) / CellsPerWord] |= CellWord(1) << (size_t(x) % CellsPerWord);
+        return;
+    }
+
+    int64_t half = size / 2;
+    ExportNode(node->NW, x, y, rowBegin, rowEnd, stride);
+    ExportNode(node->NE, x + half, y, rowBegin, rowEnd, stride);
+    ExportNode(node->SW, x, y + half, rowBegin, rowEnd, stride);
+    ExportNode(node->SE, x + half, y + half, rowBegin, rowEnd, stride);
+}
+
+void HashLife::ClearResults() {
+    for (auto& entry : m_Nodes)
+        entry.second->Result = nullptr;
+}
+
+void HashLife::Mark(Node* node) {
+    if (node->Level == 0 || node->IsMarked)
+        return;
+    node->IsMarked = true;
+    Mark(node->NW);
+    Mark(node->NE);
+    Mark(node->SW);
+    Mark(node->SE);
+}
+
+void HashLife::CollectGarbage() {
+    Mark(m_Root);
+    for (Node* empty : m_EmptyNodes)
+        Mark(empty);
+
+    for (auto it = m_Nodes.begin(); it != m_Nodes.end();) {
+        Node* node = it->second;
+        if (node->IsMarked) {
+            // Results may point to nodes that are about to be freed
+            node->IsMarked = false;
+            node->Result = nullptr;
+            ++it;
+        } else {
+            delete node;
+            it = m_Nodes.erase(it);
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "BoardState.hpp"
+#include "Rule.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// HashLife universe: an unbounded plane stored as a quadtree whose nodes are
+// hash-consed, so that identical regions share one node, and which memoizes the
+// future of every node. Repetitive patterns can then be advanced by huge numbers
+// of generations at a time.
+//
+// Unlike BoardState the plane doesn't wrap around. A board is mapped onto it with
+// its top left corner at the origin, and only that window is written back on export.
+class HashLife {
+public:
+    HashLife();
+    HashLife(const HashLife&) = delete;
+    HashLife& operator=(const HashLife&) = delete;
+    ~HashLife();
+
+    // Replaces the universe with the contents of the board
+    void Import(const BoardState& board);
+
+    // Writes the cells inside the board's window onto it, everything else is dropped. Rows are
+    // written a tile row at a time, and only the tiles that differ from previous, or from what the
+    // board held if there's none, are flagged as changed.
+    void Export(BoardState& board, const BoardState* previous = nullptr) const;
+
+    // Advances the universe by 2^log2Generations generations
+    void Step(int log2Generations);
+
+    // Rules with B0 would fill the infinite empty plane in one step, so they can't be used.
+    // Nodes only tell live cells from dead ones, which rules out Generations rules too.
+    static bool SupportsRule(const Rule& rule) { return !rule.IsBirthOnZero() && rule.GetStateCount() == 2; }
+
+    // The rule must be supported. Memoized futures are dropped when it changes.
+    void SetRule(const Rule& rule);
+    const Rule& GetRule() const { return m_Rule; }
+
+    uint64_t GetPopulation() const;
+    size_t GetNodeCount() const { return m_Nodes.size(); }
+
+private:
+    struct Node {
+        Node* NW;
+        Node* NE;
+        Node* SW;
+        Node* SE;
+        Node* Result;
+        uint64_t Population;
+        int Level;
+        bool IsMarked;
+    };
+
+    struct NodeKey {
+        const Node* Children[4];
+        bool operator==(const NodeKey& other) const {
+            return Children[0] == other.Children[0] && Children[1] == other.Children[1]
+                && Children[2] == other.Children[2] && Children[3] == other.Children[3];
+        }
+    };
+
+    struct NodeKeyHash {
+        size_t operator()(const NodeKey& key) const;
+    };
+
+    Node* Join(Node* nw, Node* ne, Node* sw, Node* se);
+    Node* GetEmpty(int level);
+    Node* Expand(Node* node);
+    Node* CenteredSubnode(Node* node);
+    Node* CenteredHorizontal(Node* w, Node* e);
+    Node* CenteredVertical(Node* n, Node* s);
+    Node* BaseCase(Node* node);
+    Node* Successor(Node* node, int log2Generations);
+    bool IsPadded(Node* node) const;
+
+    Node* Build(const BoardState& board, int level, int64_t x, int64_t y);
+    void ExportNode(const Node* node, int64_t x, int64_t y, int64_t rowBegin, int64_t rowEnd, size_t stride) const;
+
+    void ClearResults();
+    void CollectGarbage();
+    void Mark(Node* node);
+
+    Node m_Dead{};
+    Node m_Alive{};
+    Node* m_Root{ nullptr };
+    Rule m_Rule{};
+    int m_CachedStepLog2{ -1 };
+    std::vector<Node*> m_EmptyNodes;
+    std::unordered_map<NodeKey, Node*, NodeKeyHash> m_Nodes;
+
+    // A tile row of the board being exported, kept to save allocating it on every export
+    mutable std::vector<CellWord> m_ExportRows{};
+};
@@ -0,0 +1,537 @@
+#include "PatternFile.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+// RLE lines are wrapped at this length, as the format asks
+static constexpr size_t MaxRleLineLength = 70;
+
+// Hands out the input one character at a time, reading it in fixed size chunks
+class PatternStream {
+public:
+    static constexpr int End = -1;
+
+    explicit PatternStream(std::istream& in)
+        : m_In(in) {}
+
+    int Peek() {
+        if (m_Position == m_Length && !Refill())
+            return End;
+        return (unsigned char)m_Buffer[m_Position];
+    }
+
+    int Get() {
+        int c = Peek();
+        if (c != End) {
+            m_Position++;
+            if (c == '\n')
+                m_Line++;
+        }
+        return c;
+    }
+
+    void SkipLine() {
+        int c;
+        do {
+            c = Get();
+        } while (c != '\n' && c != End);
+    }
+
+    // Reads the rest of the line, up to a sane length, for headers
+    std::string ReadLine() {
+        std::string line;
+        for (int c = Get(); c != '\n' && c != End; c = Get()) {
+            if (c != '\r' && line.size() < 4096)
+                line.push_back(char(c));
+        }
+        return line;
+    }
+
+    bool IsBad() const { return m_In.bad(); }
+    size_t GetLineNumber() const { return m_Line; }
+
+private:
+    bool Refill() {
+        m_In.read(m_Buffer, sizeof(m_Buffer));
+        m_Length = size_t(m_In.gcount());
+        m_Position = 0;
+        return m_Length > 0;
+    }
+
+    std::istream& m_In;
+    char m_Buffer[64 * 1024];
+    size_t m_Position{ 0 };
+    size_t m_Length{ 0 };
+    size_t m_Line{ 1 };
+};
+
+// Places cells relative to the pattern's origin, wrapping around the board
+class PatternPlacer {
+public:
+    PatternPlacer(BoardState& board, size_t x, size_t y)
+        : m_Board(board)
+        , m_X(x % board.GetWidth())
+        , m_Y(y % board.GetHeight()) {}
+
+    void SetRun(uint64_t column, uint64_t row, uint64_t count) {
+        if (count == 0)
+            return;
+        // Patterns usually fit, so the divisions are only paid for when they don't
+        size_t width = m_Board.GetWidth();
+        size_t height = m_Board.GetHeight();
+        uint64_t cx = m_X + column;
+        uint64_t cy = m_Y + row;
+        if (cx >= width)
+            cx %= width;
+        if (cy >= height)
+            cy %= height;
+        m_Board.SetCellRun(size_t(cx), size_t(cy), size_t(std::min<uint64_t>(count, width)), true);
+    }
+
+    // Dying cells of Generations rules, one at a time since they're rare in pattern files
+    void SetStateRun(uint64_t column, uint64_t row, uint64_t count, int state) {
+        uint64_t width = m_Board.GetWidth();
+        uint64_t height = m_Board.GetHeight();
+        count = std::min<uint64_t>(count, width);
+        for (uint64_t i = 0; i < count; i++)
+            m_Board.SetState(int((m_X + column + i) % width), int((m_Y + row) % height), state);
+    }
+
+    BoardState& GetBoard() { return m_Board; }
+
+    void SetCell(int64_t column, int64_t row) {
+        int64_t width = int64_t(m_Board.GetWidth());
+        int64_t height = int64_t(m_Board.GetHeight());
+        int64_t cx = ((int64_t(m_X) + column % width) % width + width) % width;
+        int64_t cy = ((int64_t(m_Y) + row % height) % height + height) % height;
+        m_Board.SetCellRun(size_t(cx), size_t(cy), 1, true);
+    }
+
+private:
+    BoardState& m_Board;
+    size_t m_X;
+    size_t m_Y;
+};
+
+static std::string DescribeError(const PatternStream& stream, const std::string& problem) {
+    return problem + " on line " + std::to_string(stream.GetLineNumber());
+}
+
+static void ParseRleHeader(const std::string& line, PatternInfo& info) {
+    // x = m, y = n, rule = abc
+    size_t start = 0;
+    while (start < line.size()) {
+        size_t end = line.find(',', start);
+        if (end == std::string::npos)
+            end = line.size();
+
+        std::string item = line.substr(start, end - start);
+        size_t equals = item.find('=');
+        if (equals != std::string::npos) {
+            std::string key = item.substr(0, equals);
+            std::string value = item.substr(equals + 1);
+            key.erase(std::remove_if(key.begin(), key.end(), ::isspace), key.end());
+            value.erase(std::remove_if(value.begin(), value.end(), ::isspace), value.end());
+            if (key == "x")
+                info.Width = std::strtoull(value.c_str(), nullptr, 10);
+            else if (key == "y")
+                info.Height = std::strtoull(value.c_str(), nullptr, 10);
+            else if (key == "rule")
+                info.Rule = value;
+        }
+        start = end + 1;
+    }
+}
+
+static bool ReadRle(PatternStream& stream, PatternPlacer& placer, PatternInfo& info, std::string& error) {
+    // Comment lines, then the optional header
+    bool hasHeader = false;
+    while (true) {
+        int c = stream.Peek();
+        if (c == '#') {
+            stream.SkipLine();
+        } else if (c == 'x') {
+            ParseRleHeader(stream.ReadLine(), info);
+            hasHeader = true;
+            break;
+        } else if (c == '\n' || c == '\r' || c == ' ' || c == '\t') {
+            stream.Get();
+        } else {
+            break;
+        }
+    }
+
+    // Generations patterns need somewhere to keep their dying cells
+    Rule rule;
+    std::string ruleError;
+    BoardState& board = placer.GetBoard();
+    if (!info.Rule.empty() && Rule::Parse(info.Rule, rule, ruleError) && rule.GetAgePlaneCount() > board.GetAgePlaneCount())
+        board.SetAgePlaneCount(rule.GetAgePlaneCount());
+    int maxState = 1 << board.GetAgePlaneCount();
+
+    uint64_t column = 0;
+    uint64_t row = 0;
+    uint64_t count = 0;
+    uint64_t width = 0;
+    bool hasCount = false;
+    int statePrefix = 0;
+    for (int c = stream.Get(); c != PatternStream::End && c != '!'; c = stream.Get()) {
+        if (c >= '0' && c <= '9') {
+            count = count * 10 + uint64_t(c - '0');
+            hasCount = true;
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            continue;
+
+        uint64_t run = hasCount ? count : 1;
+        count = 0;
+        hasCount = false;
+        if (c == 'b' || c == '.') {
+            column += run;
+        } else if (c == 'o' || (c == 'A' && statePrefix == 0)) {
+            placer.SetRun(column, row, run);
+            column += run;
+            width = std::max(width, column);
+        } else if (c >= 'A' && c <= 'X') {
+            // Multi-state cells are dying ones, states the board can't hold are left dead
+            int state = statePrefix * 24 + (c - 'A' + 1);
+            if (state <= maxState)
+                placer.SetStateRun(column, row, run, state);
+            statePrefix = 0;
+            column += run;
+            width = std::max(width, column);
+        } else if (c >= 'p' && c <= 'y') {
+            // Prefix of a multi-state cell past X, the rest of the state follows
+            statePrefix = c - 'p' + 1;
+            hasCount = run != 1;
+            count = hasCount ? run : 0;
+        } else if (c == '$') {
+            row += run;
+            column = 0;
+        } else {
+            error = DescribeError(stream, std::string("unexpected '") + char(c) + "'");
+            return false;
+        }
+    }
+
+    if (!hasHeader) {
+        info.Width = size_t(width);
+        info.Height = size_t(row + 1);
+    }
+    return true;
+}
+
+static bool ReadCells(PatternStream& stream, PatternPlacer& placer, PatternInfo& info, std::string& error) {
+    uint64_t column = 0;
+    uint64_t row = 0;
+    uint64_t runStart = 0;
+    bool inRun = false;
+    bool lineStart = true;
+    bool hasCells = false;
+
+    for (int c = stream.Peek(); c != PatternStream::End; c = stream.Peek()) {
+        if (lineStart && c == '!') {
+            stream.SkipLine();
+            continue;
+        }
+        stream.Get();
+        lineStart = false;
+
+        bool alive = c == 'O' || c == '*';
+        if (inRun && !alive) {
+            placer.SetRun(runStart, row, column - runStart);
+            inRun = false;
+        }
+
+        if (alive) {
+            if (!inRun)
+                runStart = column;
+            inRun = true;
+            column++;
+            info.Width = size_t(std::max<uint64_t>(info.Width, column));
+        } else if (c == '.') {
+            column++;
+        } else if (c == '\n') {
+            row++;
+            column = 0;
+            lineStart = true;
+            hasCells = false;
+            continue;
+        } else if (c != '\r') {
+            error = DescribeError(stream, std::string("unexpected '") + char(c) + "'");
+            return false;
+        }
+        hasCells = true;
+    }
+
+    if (inRun)
+        placer.SetRun(runStart, row, column - runStart);
+    info.Height = size_t(hasCells ? row + 1 : row);
+    return true;
+}
+
+static bool ReadLife106(PatternStream& stream, PatternPlacer& placer, PatternInfo& info, std::string& error) {
+    int64_t minX = 0, maxX = -1, minY = 0, maxY = -1;
+    while (stream.Peek() != PatternStream::End) {
+        if (stream.Peek() == '#') {
+            stream.SkipLine();
+            continue;
+        }
+
+        // Two signed numbers, separated by blanks
+        int64_t values[2];
+        int found = 0;
+        int c = stream.Get();
+        while (c != '\n' && c != PatternStream::End) {
+            if (c == ' ' || c == '\t' || c == '\r') {
+                c = stream.Get();
+                continue;
+            }
+
+            bool negative = c == '-';
+            if (c == '-' || c == '+')
+                c = stream.Get();
+            if (c < '0' || c > '9' || found == 2) {
+                error = DescribeError(stream, "expected a pair of coordinates");
+                return false;
+            }
+
+            int64_t value = 0;
+            for (; c >= '0' && c <= '9'; c = stream.Get())
+                value = value * 10 + (c - '0');
+            values[found++] = negative ? -value : value;
+        }
+
+        if (found == 0)
+            continue;
+        if (found != 2) {
+            error = DescribeError(stream, "expected a pair of coordinates");
+            return false;
+        }
+
+        placer.SetCell(values[0], values[1]);
+        if (maxX < minX) {
+            minX = maxX = values[0];
+            minY = maxY = values[1];
+        } else {
+            minX = std::min(minX, values[0]);
+            maxX = std::max(maxX, values[0]);
+            minY = std::min(minY, values[1]);
+            maxY = std::max(maxY, values[1]);
+        }
+    }
+
+    info.Width = size_t(maxX - minX + 1);
+    info.Height = size_t(maxY - minY + 1);
+    return true;
+}
+
+PatternFormat GetPatternFormat(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+    for (char& c : extension)
+        c = char(std::tolower((unsigned char)c));
+
+    if (extension == "rle")
+        return PatternFormat::Rle;
+    if (extension == "lif" || extension == "life")
+        return PatternFormat::Life106;
+    return PatternFormat::Cells;
+}
+
+bool ReadPattern(std::istream& in, PatternFormat format, BoardState& board, size_t x, size_t y,
+    PatternInfo& info, std::string& error) {
+    PatternStream stream(in);
+    PatternPlacer placer(board, x, y);
+    info = PatternInfo();
+
+    bool ok = false;
+    switch (format) {
+    case PatternFormat::Rle: ok = ReadRle(stream, placer, info, error); break;
+    case PatternFormat::Cells: ok = ReadCells(stream, placer, info, error); break;
+    case PatternFormat::Life106: ok = ReadLife106(stream, placer, info, error); break;
+    }
+
+    if (ok && stream.IsBad()) {
+        error = DescribeError(stream, "read error");
+        return false;
+    }
+    return ok;
+}
+
+// Index of the first cell at or after x whose state is the given one, or the width if there's none
+static size_t FindCell(const BoardState& board, const CellWord* row, size_t x, bool state) {
+    size_t width = board.GetWidth();
+    size_t stride = board.GetStride();
+    CellWord flip = state ? 0 : ~CellWord(0);
+    for (size_t i = x / CellsPerWord; i < stride && x < width; i++) {
+        CellWord word = (row[i] ^ flip) & (~CellWord(0) << (x % CellsPerWord));
+        if (word != 0)
+            return std::min(width, i * CellsPerWord + FindFirstCell(word));
+        x = (i + 1) * CellsPerWord;
+    }
+    return width;
+}
+
+// Collects RLE tokens into lines of limited length
+class RleWriter {
+public:
+    explicit RleWriter(std::ostream& out)
+        : m_Out(out) {}
+
+    void Put(uint64_t count, char tag) {
+        char token[24];
+        char* end = token + sizeof(token);
+        char* start = end;
+        *--start = tag;
+        if (count != 1) {
+            do {
+                *--start = char('0' + count % 10);
+                count /= 10;
+            } while (count > 0);
+        }
+
+        size_t length = size_t(end - start);
+        if (m_Line.size() + length > MaxRleLineLength) {
+            m_Out << m_Line << '\n';
+            m_Line.clear();
+        }
+        m_Line.append(start, length);
+    }
+
+    void Finish() {
+        m_Out << m_Line << '\n';
+    }
+
+private:
+    std::ostream& m_Out;
+    std::string m_Line{};
+};
+
+// Boards with dying cells go out in the multi-state form: '.' for dead cells, 'A' for live ones
+// and 'B' onwards for the dying states
+static void WriteRleStates(RleWriter& writer, const BoardState& board) {
+    int width = int(board.GetWidth());
+    uint64_t pendingRows = 0;
+    for (size_t y = 0; y < board.GetHeight(); y++) {
+        const CellWord* row = board.GetRow(y);
+        int runState = 0;
+        uint64_t runLength = 0;
+        for (int x = 0; x <= width; x++) {
+            // Words without live or dying cells are added to a dead run whole
+            if (x % CellsPerWord == 0 && x + int(CellsPerWord) <= width && runState == 0) {
+                CellWord occupied = row[x / CellsPerWord];
+                for (int plane = 0; plane < board.GetAgePlaneCount(); plane++)
+                    occupied |= board.GetAgeRow(plane, y)[x / CellsPerWord];
+                if (occupied == 0) {
+                    runLength += CellsPerWord;
+                    x += int(CellsPerWord) - 1;
+                    continue;
+                }
+            }
+
+            // Past the end of the row comes a made up state, so the last run gets written,
+            // unless it's dead cells, which the end of the row implies
+            int state = x < width ? board.GetState(x, int(y)) : -1;
+            if (state == runState) {
+                runLength++;
+                continue;
+            }
+            if (runLength > 0 && (runState != 0 || state != -1)) {
+                if (pendingRows > 0) {
+                    writer.Put(pendingRows, '$');
+                    pendingRows = 0;
+                }
+                writer.Put(runLength, runState == 0 ? '.' : char('A' + runState - 1));
+            }
+            runState = state;
+            runLength = 1;
+        }
+        pendingRows++;
+    }
+
+    writer.Put(1, '!');
+    writer.Finish();
+}
+
+static void WriteRle(std::ostream& out, const BoardState& board, const std::string& name, const Rule& rule) {
+    out << "#N " << name << '\n';
+    out << "x = " << board.GetWidth() << ", y = " << board.GetHeight() << ", rule = " << rule.ToString() << '\n';
+
+    RleWriter writer(out);
+    if (board.GetAgePlaneCount() > 0) {
+        WriteRleStates(writer, board);
+        return;
+    }
+
+    size_t width = board.GetWidth();
+    uint64_t pendingRows = 0;
+    for (size_t y = 0; y < board.GetHeight(); y++) {
+        const CellWord* row = board.GetRow(y);
+        size_t x = FindCell(board, row, 0, true);
+        if (x < width && pendingRows > 0) {
+            writer.Put(pendingRows, '$');
+            pendingRows = 0;
+        }
+
+        size_t deadStart = 0;
+        while (x < width) {
+            size_t end = FindCell(board, row, x, false);
+            if (x > deadStart)
+                writer.Put(x - deadStart, 'b');
+            writer.Put(end - x, 'o');
+            deadStart = end;
+            x = FindCell(board, row, end, true);
+        }
+        pendingRows++;
+    }
+
+    writer.Put(1, '!');
+    writer.Finish();
+}
+
+static void WriteCells(std::ostream& out, const BoardState& board, const std::string& name) {
+    out << "!Name: " << name << '\n';
+
+    std::string line;
+    size_t width = board.GetWidth();
+    for (size_t y = 0; y < board.GetHeight(); y++) {
+        const CellWord* row = board.GetRow(y);
+        line.clear();
+        for (size_t x = FindCell(board, row, 0, true); x < width;) {
+            size_t end = FindCell(board, row, x, false);
+            line.append(x - line.size(), '.');
+            line.append(end - x, 'O');
+            x = FindCell(board, row, end, true);
+        }
+        line.push_back('\n');
+        out << line;
+    }
+}
+
+static void WriteLife106(std::ostream& out, const BoardState& board, const std::string& name) {
+    out << "#Life 1.06\n";
+    out << "#D " << name << '\n';
+
+    size_t width = board.GetWidth();
+    for (size_t y = 0; y < board.GetHeight(); y++) {
+        const CellWord* row = board.GetRow(y);
+        for (size_t x = FindCell(board, row, 0, true); x < width;) {
+            size_t end = FindCell(board, row, x, false);
+            for (; x < end; x++)
+                out << x << ' ' << y << '\n';
+            x = FindCell(board, row, end, true);
+        }
+    }
+}
+
+void WritePattern(std::ostream& out, PatternFormat format, const BoardState& board, const std::string& name, const Rule& rule) {
+    switch (format) {
+    case PatternFormat::Rle: WriteRle(out, board, name, rule); break;
+    case PatternFormat::Cells: WriteCells(out, board, name); break;
+    case PatternFormat::Life106: WriteLife106(out, board, name); break;
+    }
+}
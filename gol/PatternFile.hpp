@@ -0,0 +1,47 @@
+#pragma once
+
+#include "BoardState.hpp"
+#include "Rule.hpp"
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+
+enum class PatternFormat {
+    // Run length encoded, the usual format for sharing patterns (.rle)
+    Rle,
+    // Plaintext, one character per cell (.cells)
+    Cells,
+    // One "x y" coordinate pair per live cell (.lif, .life)
+    Life106,
+};
+
+// Picks the format from the file name's extension, plaintext if it isn't recognized
+PatternFormat GetPatternFormat(const std::string& path);
+
+// What the file said about the pattern. Width and height come from the RLE header when
+// there is one, otherwise they're the extent of the cells that were read.
+struct PatternInfo {
+    size_t Width{ 0 };
+    size_t Height{ 0 };
+    // The rule as written in the RLE header, empty if the file didn't name one
+    std::string Rule{};
+};
+
+// Reads a pattern into the board, with its origin at (x, y). Live cells are added to the board,
+// nothing is cleared, and cells past the board's edge wrap around the torus.
+//
+// The input is parsed in fixed size chunks as it streams in, and runs of live cells are written
+// a word at a time. On malformed input returns false and describes the problem in error;
+// the board may have been partially written by then.
+//
+// Multi-state RLE cells past 'A' are read as the dying states of Generations rules. If the
+// header names such a rule, the board gets the age planes it needs first, which drops any
+// dying cells it already had.
+bool ReadPattern(std::istream& in, PatternFormat format, BoardState& board, size_t x, size_t y,
+    PatternInfo& info, std::string& error);
+
+// Writes the whole board in the given format. Only RLE has a place for the rule and for
+// dying cells, the other formats are read back as Conway's Life with only the live cells.
+void WritePattern(std::ostream& out, PatternFormat format, const BoardState& board, const std::string& name, const Rule& rule);
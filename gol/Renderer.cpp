@@ -1,5 +1,9 @@
 #include "Renderer.hpp"
 #include "Common.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
 #include <string>
 #include <vector>
 
@@ -7,56 +11,450 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-void Renderer::Init() {}
-void Renderer::Deinit() {}
+// The board is drawn as a single quad. Its fragment shader looks the cell under each pixel
+// up in a texture holding the packed cell words as they are in memory, two texels per word,
+// followed by the age planes of Generations rules. When zoomed far out it reads a level of
+// the density pyramid instead, one texel per block.
+static const char* VertexShaderSource = R"(
+#version 130
+uniform mat4 u_Transform;
+uniform vec2 u_RectOrigin;
+uniform vec2 u_RectSize;
+uniform float u_CellSize;
+in vec2 a_Corner;
+out vec2 v_Cell;
+
+void main() {
+    v_Cell = u_RectOrigin + a_Corner * u_RectSize;
+    gl_Position = u_Transform * vec4(v_Cell * u_CellSize, 0.0, 1.0);
+}
+)";
+
+static const char* FragmentShaderSource = R"(
+#version 130
+uniform usampler2D u_Cells;
+uniform usampler2D u_Density;
+uniform float u_BlockSize;
+uniform int u_AgePlanes;
+uniform int u_PlaneTexels;
+uniform float u_StateCount;
+uniform vec2 u_BoardSize;
+uniform vec3 u_GradientLeft;
+uniform vec3 u_GradientRight;
+uniform bool u_MarkSelected;
+uniform vec2 u_SelectedCell;
+in vec2 v_Cell;
+out vec4 o_Color;
+
+void main() {
+    // Cells outside of the board belong to its wrapped copies
+    vec2 position = floor(v_Cell);
+    ivec2 cell = clamp(ivec2(mod(position, u_BoardSize)), ivec2(0), ivec2(u_BoardSize) - 1);
+    if (u_MarkSelected && cell == ivec2(u_SelectedCell)) {
+        o_Color = vec4(1.0);
+        return;
+    }
+
+    float x = v_Cell.x - (position.x - float(cell.x));
+    vec3 color = mix(u_GradientLeft, u_GradientRight, x / u_BoardSize.x);
+
+    if (u_BlockSize > 0.0) {
+        // Blocks along the board's edge are cut short, so their density is over the cells they have
+        vec2 blockStart = floor(vec2(cell) / u_BlockSize) * u_BlockSize;
+        vec2 blockCells = min(blockStart + u_BlockSize, u_BoardSize) - blockStart;
+        uint count = texelFetch(u_Density, ivec2(blockStart / u_BlockSize), 0).r;
+        float density = float(count) / (blockCells.x * blockCells.y);
+
+        // Any live cell keeps its block visible, however sparse it is
+        float intensity = count == 0u ? 0.0 : mix(0.25, 1.0, sqrt(density));
+        o_Color = vec4(color * intensity, 1.0);
+        return;
+    }
+
+    uint bits = texelFetch(u_Cells, ivec2(cell.x / 32, cell.y), 0).r;
+    int state = int((bits >> uint(cell.x % 32)) & 1u);
+
+    // Dying cells are state 2 and up, their age plus one
+    int age = 0;
+    for (int plane = 0; plane < u_AgePlanes && state == 0; plane++) {
+        uint ageBits = texelFetch(u_Cells, ivec2(u_PlaneTexels * (plane + 1) + cell.x / 32, cell.y), 0).r;
+        age |= int((ageBits >> uint(cell.x % 32)) & 1u) << plane;
+    }
+    if (age > 0)
+        state = age + 1;
+
+    if (u_StateCount > 2.0)
+        color = mix(u_GradientLeft, u_GradientRight, clamp(float(state - 1) / (u_StateCount - 2.0), 0.0, 1.0));
+    o_Color = state != 0 ? vec4(color, 1.0) : vec4(0.0, 0.0, 0.0, 1.0);
+}
+)";
+
+static GLuint CompileShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cerr << "Board shader failed to compile, falling back to immediate mode:\n" << log << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader) {
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glBindAttribLocation(program, 0, "a_Corner");
+    glBindFragDataLocation(program, 0, "o_Color");
+    glLinkProgram(program);
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        std::cerr << "Board shader failed to link, falling back to immediate mode:\n" << log << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void Renderer::Init() {
+    if (!GLAD_GL_VERSION_3_0)
+        return;
+
+    GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, VertexShaderSource);
+    GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, FragmentShaderSource);
+    if (vertexShader && fragmentShader)
+        m_Program = LinkProgram(vertexShader, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    if (!m_Program)
+        return;
+
+    m_TransformLocation = glGetUniformLocation(m_Program, "u_Transform");
+    m_BoardSizeLocation = glGetUniformLocation(m_Program, "u_BoardSize");
+    m_RectOriginLocation = glGetUniformLocation(m_Program, "u_RectOrigin");
+    m_RectSizeLocation = glGetUniformLocation(m_Program, "u_RectSize");
+    m_CellSizeLocation = glGetUniformLocation(m_Program, "u_CellSize");
+    m_CellsLocation = glGetUniformLocation(m_Program, "u_Cells");
+    m_DensityLocation = glGetUniformLocation(m_Program, "u_Density");
+    m_BlockSizeLocation = glGetUniformLocation(m_Program, "u_BlockSize");
+    m_AgePlanesLocation = glGetUniformLocation(m_Program, "u_AgePlanes");
+    m_PlaneTexelsLocation = glGetUniformLocation(m_Program, "u_PlaneTexels");
+    m_StateCountLocation = glGetUniformLocation(m_Program, "u_StateCount");
+    m_GradientLeftLocation = glGetUniformLocation(m_Program, "u_GradientLeft");
+    m_GradientRightLocation = glGetUniformLocation(m_Program, "u_GradientRight");
+    m_MarkSelectedLocation = glGetUniformLocation(m_Program, "u_MarkSelected");
+    m_SelectedCellLocation = glGetUniformLocation(m_Program, "u_SelectedCell");
+
+    const float corners[] = { 0, 0, 1, 0, 0, 1, 1, 1 };
+    glGenVertexArrays(1, &m_VertexArray);
+    glGenBuffers(1, &m_VertexBuffer);
+    glBindVertexArray(m_VertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Integer textures can't be filtered, nearest sampling is the only valid choice
+    for (GLuint* texture : { &m_Texture, &m_DensityTexture }) {
+        glGenTextures(1, texture);
+        glBindTexture(GL_TEXTURE_2D, *texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Renderer::Deinit() {
+    if (!m_Program)
+        return;
+
+    glDeleteTextures(1, &m_Texture);
+    glDeleteTextures(1, &m_DensityTexture);
+    glDeleteBuffers(1, &m_VertexBuffer);
+    glDeleteVertexArrays(1, &m_VertexArray);
+    glDeleteProgram(m_Program);
+    m_Texture = m_DensityTexture = m_VertexBuffer = m_VertexArray = m_Program = 0;
+    m_TextureWidth = m_TextureHeight = 0;
+    m_DensityTextureWidth = m_DensityTextureHeight = 0;
+    m_TextureSerial = m_DensityTextureSerial = 0;
+}
 
 void Renderer::Render(const BoardState& state, float windowWidth, float windowHeight, const RenderSettings& settings) {
-    // Current renderer is based on immediate mode OpenGL,
-    // because I really can't be arsed to make a more "proper" solution with shaders,
-    // buffers and all that.
-    //
-    // If I've enough time I may be able to pull off a non-compatibility-profile solution.
-    //
+    RenderBoard(state, nullptr, windowWidth, windowHeight, settings);
+}
 
-    float cellScale = settings.CellSize;
+void Renderer::Render(const BoardSnapshot& snapshot, float windowWidth, float windowHeight, const RenderSettings& settings) {
+    RenderBoard(snapshot.Board, &snapshot, windowWidth, windowHeight, settings);
+}
 
-    glm::mat4 projection = glm::ortho(0.0f, windowWidth, 0.0f, windowHeight, 0.0001f, 1000.0f);
-    glMatrixMode(GL_PROJECTION);
-    glLoadMatrixf(glm::value_ptr(projection));
+void Renderer::RenderBoard(const BoardState& state, const BoardSnapshot* snapshot, float windowWidth, float windowHeight, const RenderSettings& settings) {
+    auto start = std::chrono::steady_clock::now();
+    m_LastUploadBytes = 0;
 
+    glm::mat4 projection = glm::ortho(0.0f, windowWidth, 0.0f, windowHeight, 0.0001f, 1000.0f);
     glm::mat4 view(1.0f);
     view = glm::translate(view, -glm::vec3(CameraX, CameraY, 1));
     view = glm::scale(view, glm::vec3(CameraZoom, CameraZoom, 1));
-    glMatrixMode(GL_MODELVIEW);
-    glLoadMatrixf(glm::value_ptr(view));
 
+    // Boards taller than the biggest texture the driver takes have to go the slow way
+    GLint maxTextureSize = 0;
+    if (IsTextureRendererSupported())
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+    CellRect visible = GetVisibleCells(state, windowWidth, windowHeight, settings);
+    const DensityLevel* level = visible.GetArea() > 0 ? PickDensityLevel(state, settings) : nullptr;
+    int blockSize = level ? 1 << level->Log2BlockSize : 1;
+    m_LastVisitedCells = size_t((visible.X1 - visible.X0 + blockSize - 1) / blockSize)
+        * size_t((visible.Y1 - visible.Y0 + blockSize - 1) / blockSize);
+    m_LastTotalCells = state.GetWidth() * state.GetHeight();
+    m_LastBlockSize = blockSize;
+
+    if (visible.GetArea() == 0) {
+        // Nothing of the board is on screen
+    } else if (UseTextureRenderer && (level || state.GetHeight() <= size_t(maxTextureSize))) {
+        RenderTexture(state, snapshot, level, visible, projection * view, settings);
+    } else {
+        glMatrixMode(GL_PROJECTION);
+        glLoadMatrixf(glm::value_ptr(projection));
+        glMatrixMode(GL_MODELVIEW);
+        glLoadMatrixf(glm::value_ptr(view));
+        if (level)
+            RenderDensityImmediate(state, *level, visible, settings);
+        else
+            RenderImmediate(state, visible, settings);
+    }
+
+    m_LastRenderMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+CellRect Renderer::GetVisibleCells(const BoardState& state, float windowWidth, float windowHeight, const RenderSettings& settings) const {
+    // Inverse of the view transform: world = (screen + camera) / zoom
+    float scale = CameraZoom * settings.CellSize;
+    float left = CameraX / scale;
+    float bottom = CameraY / scale;
+    float right = (CameraX + windowWidth) / scale;
+    float top = (CameraY + windowHeight) / scale;
+
+    // Limits are applied before converting, so far away cameras can't overflow the integers
+    float width = float(state.GetWidth());
+    float height = float(state.GetHeight());
+    float minX = settings.WrapAround ? -width : 0;
+    float maxX = settings.WrapAround ? 2 * width : width;
+    float minY = settings.WrapAround ? -height : 0;
+    float maxY = settings.WrapAround ? 2 * height : height;
+
+    CellRect rect;
+    rect.X0 = int(std::clamp(std::floor(left), minX, maxX));
+    rect.X1 = int(std::clamp(std::ceil(right), minX, maxX));
+    rect.Y0 = int(std::clamp(std::floor(bottom), minY, maxY));
+    rect.Y1 = int(std::clamp(std::ceil(top), minY, maxY));
+    return rect;
+}
+
+const DensityLevel* Renderer::PickDensityLevel(const BoardState& state, const RenderSettings& settings) const {
+    float cellsPerPixel = 1.0f / (CameraZoom * settings.CellSize);
+    if (!UseDensityLevels || cellsPerPixel < float(1 << DensityBaseLog2BlockSize))
+        return nullptr;
+
+    // The biggest blocks that still get at least a pixel each
+    const std::vector<DensityLevel>& levels = state.GetDensityPyramid();
+    int log2BlockSize = int(std::floor(std::log2(cellsPerPixel)));
+    size_t index = std::min(size_t(log2BlockSize - DensityBaseLog2BlockSize), levels.size() - 1);
+    return &levels[index];
+}
+
+void Renderer::UploadDensityLevel(const DensityLevel& level, const BoardSnapshot* snapshot) {
+    // Levels are small, so they're sent whole, but only when the level or the board changed
+    bool resized = level.Width != m_DensityTextureWidth || level.Height != m_DensityTextureHeight;
+    if (!resized && snapshot && snapshot->Serial == m_DensityTextureSerial && level.Log2BlockSize == m_DensityTextureLog2BlockSize)
+        return;
+    m_DensityTextureSerial = snapshot ? snapshot->Serial : 0;
+    m_DensityTextureLog2BlockSize = level.Log2BlockSize;
+    m_LastUploadBytes += level.Counts.size() * sizeof(uint32_t);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    if (resized) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, GLsizei(level.Width), GLsizei(level.Height), 0,
+            GL_RED_INTEGER, GL_UNSIGNED_INT, level.Counts.data());
+        m_DensityTextureWidth = level.Width;
+        m_DensityTextureHeight = level.Height;
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GLsizei(level.Width), GLsizei(level.Height),
+            GL_RED_INTEGER, GL_UNSIGNED_INT, level.Counts.data());
+    }
+}
+
+void Renderer::UploadBoard(const BoardState& state, const BoardSnapshot* snapshot) {
+    // Rows are contiguous and a multiple of 8 bytes long, so the board goes up as is.
+    // Each 64 bit word becomes two texels, low half first, as on little endian machines.
+    size_t planeWidth = state.GetStride() * 2;
+    int planes = 1 + state.GetAgePlaneCount();
+    size_t width = planeWidth * size_t(planes);
+    size_t height = state.GetHeight();
+    size_t columns = state.GetTileColumns();
+
+    // Words [begin, end) of rows [y, y + rows), in every plane
+    auto uploadRect = [&](size_t begin, size_t end, size_t y, size_t rows) {
+        for (int plane = 0; plane < planes; plane++) {
+            const CellWord* data = plane == 0 ? state.GetRow(y) : state.GetAgeRow(plane - 1, y);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, GLint(planeWidth * size_t(plane) + begin * 2), GLint(y),
+                GLsizei((end - begin) * 2), GLsizei(rows), GL_RED_INTEGER, GL_UNSIGNED_INT, data + begin);
+        }
+        m_LastUploadBytes += (end - begin) * rows * sizeof(CellWord) * size_t(planes);
+    };
+
+    // Only tiles newer than the texture need to go up. That takes a snapshot following
+    // the one the texture was filled from, and a texture of the right size.
+    bool resized = width != m_TextureWidth || height != m_TextureHeight;
+    bool isIncremental = !resized && snapshot && m_TextureSerial != 0 && snapshot->Serial >= m_TextureSerial
+        && snapshot->TileSerials.size() == columns * state.GetTileRows();
+    uint64_t uploadedSerial = m_TextureSerial;
+    m_TextureSerial = snapshot ? snapshot->Serial : 0;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, GLint(planeWidth));
+    if (resized) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, GLsizei(width), GLsizei(height), 0,
+            GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        m_TextureWidth = width;
+        m_TextureHeight = height;
+        uploadRect(0, columns, 0, height);
+    } else if (!isIncremental) {
+        uploadRect(0, columns, 0, height);
+    } else if (snapshot->Serial != uploadedSerial) {
+        // Each run of changed tiles in a tile row goes up as one rectangle
+        for (size_t ty = 0; ty < state.GetTileRows(); ty++) {
+            const uint64_t* serials = &snapshot->TileSerials[ty * columns];
+            size_t y = ty * TileSize;
+            size_t rows = std::min(TileSize, height - y);
+            for (size_t tx = 0; tx < columns; tx++) {
+                if (serials[tx] <= uploadedSerial)
+                    continue;
+                size_t begin = tx;
+                while (tx + 1 < columns && serials[tx + 1] > uploadedSerial)
+                    tx++;
+                uploadRect(begin, tx + 1, y, rows);
+            }
+        }
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+void Renderer::RenderTexture(const BoardState& state, const BoardSnapshot* snapshot, const DensityLevel* level, const CellRect& visible, const glm::mat4& transform, const RenderSettings& settings) {
+    // Only the texture the shader is going to read gets uploaded. Tile serials keep adding up,
+    // so the other one can catch up on everything it missed once it's needed again.
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_DensityTexture);
+    if (level)
+        UploadDensityLevel(*level, snapshot);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_Texture);
+    if (!level)
+        UploadBoard(state, snapshot);
+
+    glUseProgram(m_Program);
+    glUniformMatrix4fv(m_TransformLocation, 1, GL_FALSE, glm::value_ptr(transform));
+    glUniform2f(m_BoardSizeLocation, float(state.GetWidth()), float(state.GetHeight()));
+    glUniform2f(m_RectOriginLocation, float(visible.X0), float(visible.Y0));
+    glUniform2f(m_RectSizeLocation, float(visible.X1 - visible.X0), float(visible.Y1 - visible.Y0));
+    glUniform1f(m_CellSizeLocation, settings.CellSize);
+    glUniform1i(m_CellsLocation, 0);
+    glUniform1i(m_DensityLocation, 1);
+    glUniform1f(m_BlockSizeLocation, level ? float(1 << level->Log2BlockSize) : 0.0f);
+    glUniform1i(m_AgePlanesLocation, state.GetAgePlaneCount());
+    glUniform1i(m_PlaneTexelsLocation, GLint(state.GetStride() * 2));
+    glUniform1f(m_StateCountLocation, float(settings.StateCount));
+    glUniform3fv(m_GradientLeftLocation, 1, glm::value_ptr(settings.GradientLeft));
+    glUniform3fv(m_GradientRightLocation, 1, glm::value_ptr(settings.GradientRight));
+    glUniform1i(m_MarkSelectedLocation, settings.MarkSelectedCell ? 1 : 0);
+    glUniform2f(m_SelectedCellLocation, settings.SelectedCell.x, settings.SelectedCell.y);
+
+    glBindVertexArray(m_VertexArray);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+
+    glUseProgram(0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Renderer::RenderImmediate(const BoardState& state, const CellRect& visible, const RenderSettings& settings) {
+    // Fallback for contexts without shader support. Emits a quad per live cell,
+    // so it gets slow on big and busy boards.
+
+    float cellScale = settings.CellSize;
     float boardSizeWidth = state.GetWidth() * cellScale;
-    float boardSizeHeight = state.GetHeight() * cellScale;
+    int width = int(state.GetWidth());
+    int height = int(state.GetHeight());
 
     glBegin(GL_QUADS);
 
-    // Draw a black background
+    // Draw a black background under the visible part
+    float left = visible.X0 * cellScale;
+    float right = visible.X1 * cellScale;
+    float bottom = visible.Y0 * cellScale;
+    float top = visible.Y1 * cellScale;
     glColor4f(0, 0, 0, 1);
-    glVertex2f(0 * boardSizeWidth, 1 * boardSizeHeight);
+    glVertex2f(left, top);
     glColor4f(0, 0, 0, 1);
-    glVertex2f(1 * boardSizeWidth, 1 * boardSizeHeight);
+    glVertex2f(right, top);
     glColor4f(0, 0, 0, 1);
-    glVertex2f(1 * boardSizeWidth, 0 * boardSizeHeight);
+    glVertex2f(right, bottom);
     glColor4f(0, 0, 0, 1);
-    glVertex2f(0 * boardSizeWidth, 0 * boardSizeHeight);
+    glVertex2f(left, bottom);
 
     glm::vec3 gradientStep = (settings.GradientRight - settings.GradientLeft) / boardSizeWidth;
     
-    for (size_t y = 0; y < state.GetHeight(); y++) {
-        for (size_t x = 0; x < state.GetWidth(); x++) {
-            bool isSelected = settings.MarkSelectedCell && glm::vec2(x, y) == settings.SelectedCell;
+    for (int y = visible.Y0; y < visible.Y1; y++) {
+        // Positions outside of the board show its wrapped copies
+        int cellY = (y % height + height) % height;
+        const CellWord* row = state.GetRow(size_t(cellY));
+
+        for (int x = visible.X0; x < visible.X1; x++) {
+            int cellX = (x % width + width) % width;
+            bool isSelected = settings.MarkSelectedCell && glm::vec2(cellX, cellY) == settings.SelectedCell;
+
+            // Skip over the rest of empty words, without going past the end of this copy
+            CellWord word = row[cellX / CellsPerWord];
+            for (int plane = 0; plane < state.GetAgePlaneCount(); plane++)
+                word |= state.GetAgeRow(plane, size_t(cellY))[cellX / CellsPerWord];
+            word >>= cellX % CellsPerWord;
+            if (word == 0 && !isSelected) {
+                int skip = std::min(int(CellsPerWord - cellX % CellsPerWord), width - cellX);
+                if (!settings.MarkSelectedCell)
+                    x += skip - 1;
+                continue;
+            }
 
-            if (state.GetCellState(x, y) || isSelected) {
-                float currentLeft = x * cellScale;
+            if ((word & 1) || isSelected) {
+                float currentLeft = cellX * cellScale;
 
                 float alpha = 1;
                 glm::vec3 gradientLeft = settings.GradientLeft + gradientStep * currentLeft;
                 glm::vec3 gradientRight = gradientLeft + gradientStep;
+                if (settings.StateCount > 2) {
+                    float t = std::clamp(float(state.GetState(cellX, cellY) - 1) / float(settings.StateCount - 2), 0.0f, 1.0f);
+                    gradientLeft = gradientRight = glm::mix(settings.GradientLeft, settings.GradientRight, t);
+                }
                 
                 if (isSelected) {
                     glColor4f(1, 1, 1, alpha);
@@ -83,3 +481,60 @@ void Renderer::Render(const BoardState& state, float windowWidth, float windowHe
     
     glEnd();
 }
+
+void Renderer::RenderDensityImmediate(const BoardState& state, const DensityLevel& level, const CellRect& visible, const RenderSettings& settings) {
+    // Same shading as the texture path, one quad per occupied block
+    float cellScale = settings.CellSize;
+    int width = int(state.GetWidth());
+    int height = int(state.GetHeight());
+    int blockSize = 1 << level.Log2BlockSize;
+    glm::vec3 gradientStep = (settings.GradientRight - settings.GradientLeft) / float(width);
+
+    glBegin(GL_QUADS);
+
+    glColor4f(0, 0, 0, 1);
+    glVertex2f(visible.X0 * cellScale, visible.Y1 * cellScale);
+    glVertex2f(visible.X1 * cellScale, visible.Y1 * cellScale);
+    glVertex2f(visible.X1 * cellScale, visible.Y0 * cellScale);
+    glVertex2f(visible.X0 * cellScale, visible.Y0 * cellScale);
+
+    // Copies of the board don't line up with the block grid unless the board's size is a
+    // multiple of the block size, so each copy is walked on its own
+    int copies = settings.WrapAround ? 1 : 0;
+    for (int copyY = -copies; copyY <= copies; copyY++) {
+        int offsetY = copyY * height;
+        int y0 = std::max(visible.Y0 - offsetY, 0);
+        int y1 = std::min(visible.Y1 - offsetY, height);
+        for (int copyX = -copies; copyX <= copies; copyX++) {
+            int offsetX = copyX * width;
+            int x0 = std::max(visible.X0 - offsetX, 0);
+            int x1 = std::min(visible.X1 - offsetX, width);
+            if (x0 >= x1 || y0 >= y1)
+                continue;
+
+            for (int by = y0 / blockSize; by <= (y1 - 1) / blockSize; by++) {
+                int top = std::min((by + 1) * blockSize, height);
+                for (int bx = x0 / blockSize; bx <= (x1 - 1) / blockSize; bx++) {
+                    uint32_t count = level.GetCount(size_t(bx), size_t(by));
+                    if (count == 0)
+                        continue;
+
+                    int right = std::min((bx + 1) * blockSize, width);
+                    float density = float(count) / float((right - bx * blockSize) * (top - by * blockSize));
+                    float intensity = 0.25f + 0.75f * std::sqrt(density);
+                    glm::vec3 color = (settings.GradientLeft + gradientStep * float(bx * blockSize)) * intensity;
+
+                    float left = float(offsetX + bx * blockSize) * cellScale;
+                    float bottom = float(offsetY + by * blockSize) * cellScale;
+                    glColor4f(color.r, color.g, color.b, 1);
+                    glVertex2f(left, float(offsetY + top) * cellScale);
+                    glVertex2f(float(offsetX + right) * cellScale, float(offsetY + top) * cellScale);
+                    glVertex2f(float(offsetX + right) * cellScale, bottom);
+                    glVertex2f(left, bottom);
+                }
+            }
+        }
+    }
+
+    glEnd();
+}
@@ -12,6 +12,23 @@ struct RenderSettings {
     glm::vec2 SelectedCell{ 0, 0 };
 
     float CellSize{ 5 };
+
+    // Also draws the copies of the torus next to the board, one in each direction
+    bool WrapAround{ false };
+
+    // States of the rule being run. Under Generations rules, with more than 2 states, cells are
+    // colored by their state along the gradient, from live cells to the oldest dying ones.
+    int StateCount{ 2 };
+};
+
+// Cells [X0, X1) x [Y0, Y1). Coordinates outside of the board stand for its wrapped copies.
+struct CellRect {
+    int X0{ 0 };
+    int Y0{ 0 };
+    int X1{ 0 };
+    int Y1{ 0 };
+
+    size_t GetArea() const { return size_t(X1 - X0) * size_t(Y1 - Y0); }
 };
 
 class Renderer {
@@ -20,11 +37,89 @@ public:
     void Init();
     void Deinit();
 
+    // Uploads the whole board
     void Render(const BoardState&, float windowWidth, float windowHeight, const RenderSettings&);
 
+    // Uploads only the tiles that changed since the snapshot drawn before, and nothing at all
+    // while no newer snapshot comes in. Meant for a stream of snapshots from a single controller.
+    void Render(const BoardSnapshot&, float windowWidth, float windowHeight, const RenderSettings&);
+
+    // The texture renderer needs OpenGL 3.0 and GLSL 1.30. Without them, or when it's
+    // turned off, the board is drawn cell by cell in immediate mode.
+    bool IsTextureRendererSupported() const { return m_Program != 0; }
+    bool UseTextureRenderer{ true };
+
+    // Zoomed out past 8 cells per pixel, blocks of cells are drawn shaded by their population,
+    // read from the board's density pyramid at the level matching a pixel's size. The cost
+    // of a frame then follows the window's size rather than the board's.
+    bool UseDensityLevels{ true };
+
+    // Bytes of texture data sent to the GPU by the last Render call
+    size_t GetLastUploadBytes() const { return m_LastUploadBytes; }
+
+    // Side of the blocks the last Render call drew, 1 if it drew single cells
+    int GetLastBlockSize() const { return m_LastBlockSize; }
+
+    // CPU time spent in the last Render call, including the texture upload
+    double GetLastRenderMillis() const { return m_LastRenderMillis; }
+
+    // Cells or blocks the last Render call looked at, and the board's cell count
+    size_t GetLastVisitedCells() const { return m_LastVisitedCells; }
+    size_t GetLastTotalCells() const { return m_LastTotalCells; }
+
+    // Cells covered by the window, limited to the board and the copies drawn around it
+    CellRect GetVisibleCells(const BoardState&, float windowWidth, float windowHeight, const RenderSettings&) const;
+
     float CameraX{ 0 };
     float CameraY{ 0 };
     float CameraZoom{ 1 };
 
 private:
+    void RenderBoard(const BoardState&, const BoardSnapshot*, float windowWidth, float windowHeight, const RenderSettings&);
+    const DensityLevel* PickDensityLevel(const BoardState&, const RenderSettings&) const;
+    void RenderTexture(const BoardState&, const BoardSnapshot*, const DensityLevel*, const CellRect& visible, const glm::mat4& transform, const RenderSettings&);
+    void RenderImmediate(const BoardState&, const CellRect& visible, const RenderSettings&);
+    void RenderDensityImmediate(const BoardState&, const DensityLevel&, const CellRect& visible, const RenderSettings&);
+    void UploadBoard(const BoardState&, const BoardSnapshot*);
+    void UploadDensityLevel(const DensityLevel&, const BoardSnapshot*);
+
+    GLuint m_Program{ 0 };
+    GLuint m_VertexArray{ 0 };
+    GLuint m_VertexBuffer{ 0 };
+    GLuint m_Texture{ 0 };
+    GLuint m_DensityTexture{ 0 };
+    GLint m_TransformLocation{ -1 };
+    GLint m_BoardSizeLocation{ -1 };
+    GLint m_RectOriginLocation{ -1 };
+    GLint m_RectSizeLocation{ -1 };
+    GLint m_CellSizeLocation{ -1 };
+    GLint m_CellsLocation{ -1 };
+    GLint m_DensityLocation{ -1 };
+    GLint m_BlockSizeLocation{ -1 };
+    GLint m_AgePlanesLocation{ -1 };
+    GLint m_PlaneTexelsLocation{ -1 };
+    GLint m_StateCountLocation{ -1 };
+    GLint m_GradientLeftLocation{ -1 };
+    GLint m_GradientRightLocation{ -1 };
+    GLint m_MarkSelectedLocation{ -1 };
+    GLint m_SelectedCellLocation{ -1 };
+
+    // Size of the texture in 32 bit texels, two per cell word. Age planes are placed to the
+    // right of the live cells, each as wide as the board's rows.
+    size_t m_TextureWidth{ 0 };
+    size_t m_TextureHeight{ 0 };
+    size_t m_DensityTextureWidth{ 0 };
+    size_t m_DensityTextureHeight{ 0 };
+
+    // Serial of the snapshot each texture was last brought up to date with, 0 if the texture
+    // holds a board that didn't come from a snapshot
+    uint64_t m_TextureSerial{ 0 };
+    uint64_t m_DensityTextureSerial{ 0 };
+    int m_DensityTextureLog2BlockSize{ 0 };
+
+    double m_LastRenderMillis{ 0 };
+    size_t m_LastUploadBytes{ 0 };
+    size_t m_LastVisitedCells{ 0 };
+    size_t m_LastTotalCells{ 0 };
+    int m_LastBlockSize{ 1 };
 };
@@ -0,0 +1,139 @@
+#include "Rule.hpp"
+
+#include <cctype>
+
+const NamedRule KnownRules[] = {
+    { "Conway's Life", "B3/S23" },
+    { "HighLife", "B36/S23" },
+    { "Day & Night", "B3678/S34678" },
+    { "Seeds", "B2/S" },
+    { "Life without Death", "B3/S012345678" },
+    { "Maze", "B3/S12345" },
+    { "Replicator", "B1357/S1357" },
+    { "2x2", "B36/S125" },
+    { "Diamoeba", "B35678/S5678" },
+    { "Morley", "B368/S245" },
+    { "Brian's Brain", "B2/S/C3" },
+    { "Star Wars", "B2/S345/C4" },
+    { "Frogs", "B34/S12/C3" },
+    { "Sticks", "B2/S3456/C6" },
+    { "Belzhab", "B23/S23/C8" },
+};
+const size_t KnownRuleCount = sizeof(KnownRules) / sizeof(KnownRules[0]);
+
+// Reads the digits at text[i], setting their bits in mask
+static bool ParseCounts(const std::string& text, size_t& i, uint16_t& mask, std::string& error) {
+    for (; i < text.size() && std::isdigit((unsigned char)text[i]); i++) {
+        int count = text[i] - '0';
+        if (count > 8) {
+            error = "a cell has at most 8 neighbors, got " + std::string(1, text[i]) + " in " + text;
+            return false;
+        }
+        mask |= uint16_t(1 << count);
+    }
+    return true;
+}
+
+// Reads the state count at text[i]
+static bool ParseStateCount(const std::string& text, size_t& i, int& states, std::string& error) {
+    size_t start = i;
+    states = 0;
+    for (; i < text.size() && std::isdigit((unsigned char)text[i]) && states <= Rule::MaxStateCount; i++)
+        states = states * 10 + (text[i] - '0');
+    if (i == start || states < 2 || states > Rule::MaxStateCount) {
+        error = "the state count must be between 2 and " + std::to_string(Rule::MaxStateCount) + " in " + text;
+        return false;
+    }
+    return true;
+}
+
+bool Rule::Parse(const std::string& text, Rule& rule, std::string& error) {
+    std::string trimmed;
+    for (char c : text) {
+        if (!std::isspace((unsigned char)c))
+            trimmed += c;
+    }
+    if (trimmed.empty()) {
+        error = "the rule is empty";
+        return false;
+    }
+
+    uint16_t birth = 0;
+    uint16_t survival = 0;
+    int states = 2;
+    size_t i = 0;
+
+    // The old notation is just the two lists of counts, survival first, then the state count
+    if (std::isdigit((unsigned char)trimmed[0]) || trimmed[0] == '/') {
+        if (!ParseCounts(trimmed, i, survival, error))
+            return false;
+        if (i >= trimmed.size() || trimmed[i] != '/') {
+            error = "expected B/S notation, like B3/S23, got " + text;
+            return false;
+        }
+        i++;
+        if (!ParseCounts(trimmed, i, birth, error))
+            return false;
+        if (i < trimmed.size() && trimmed[i] == '/') {
+            i++;
+            if (!ParseStateCount(trimmed, i, states, error))
+                return false;
+        }
+    } else {
+        bool seenBirth = false;
+        bool seenSurvival = false;
+        bool seenStates = false;
+        while (i < trimmed.size()) {
+            char letter = char(std::toupper((unsigned char)trimmed[i]));
+            bool isBirth = letter == 'B';
+            bool isSurvival = letter == 'S';
+            bool isStates = letter == 'C' || letter == 'G';
+            if ((isBirth && seenBirth) || (isSurvival && seenSurvival) || (isStates && seenStates)
+                || (!isBirth && !isSurvival && !isStates)) {
+                error = "expected B/S notation, like B3/S23, got " + text;
+                return false;
+            }
+            i++;
+            if (isStates) {
+                if (!ParseStateCount(trimmed, i, states, error))
+                    return false;
+                seenStates = true;
+            } else {
+                if (!ParseCounts(trimmed, i, isBirth ? birth : survival, error))
+                    return false;
+                (isBirth ? seenBirth : seenSurvival) = true;
+            }
+
+            if (i < trimmed.size() && trimmed[i] == '/')
+                i++;
+        }
+        if (!seenBirth || !seenSurvival) {
+            error = "a rule needs both a B and an S part, got " + text;
+            return false;
+        }
+    }
+
+    if (i != trimmed.size()) {
+        error = "unexpected text after the rule in " + text;
+        return false;
+    }
+
+    rule = Rule(birth, survival, states);
+    return true;
+}
+
+std::string Rule::ToString() const {
+    std::string text = "B";
+    for (int count = 0; count <= 8; count++) {
+        if (GetNext(false, count))
+            text += char('0' + count);
+    }
+    text += "/S";
+    for (int count = 0; count <= 8; count++) {
+        if (GetNext(true, count))
+            text += char('0' + count);
+    }
+    if (m_StateCount > 2)
+        text += "/C" + std::to_string(m_StateCount);
+    return text;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "BoardState.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Life-like rule: whether a cell lives in the next generation depends only on its own state
+// and on how many of its 8 neighbors are alive. Stored as a 2x9 table of bits, a birth row
+// for dead cells and a survival row for live ones, each indexed by the neighbor count.
+//
+// Generations rules add dying states: a live cell that doesn't survive goes through
+// StateCount - 2 of them, one per generation, before it's dead. Dying cells don't count
+// as neighbors and can't be born again until they're dead.
+class Rule {
+public:
+    // The most states the board's age planes can tell apart
+    static constexpr int MaxStateCount = (1 << MaxAgePlanes) + 1;
+
+    // Conway's Game of Life, B3/S23
+    Rule() = default;
+
+    // Bit n of each mask is set if n neighbors lead to a live cell
+    Rule(uint16_t birthMask, uint16_t survivalMask, int stateCount = 2)
+        : m_Birth(birthMask & AllCounts)
+        , m_Survival(survivalMask & AllCounts)
+        , m_StateCount(stateCount < 2 ? 2 : stateCount > MaxStateCount ? MaxStateCount : stateCount) {}
+
+    // Parses B/S notation such as "B36/S23", with an optional state count for Generations rules
+    // as in "B2/S/C3". Letters may be lower case, the slashes may be left out and the parts may
+    // come in any order. The older "23/3" and "/2/3" forms (survival/birth/states) work too.
+    // On malformed input returns false and describes the problem in error.
+    static bool Parse(const std::string& text, Rule& rule, std::string& error);
+
+    // B/S notation with the counts in increasing order, and the state count if it isn't 2
+    std::string ToString() const;
+
+    bool GetNext(bool alive, int neighbors) const {
+        return (((alive ? m_Survival : m_Birth) >> neighbors) & 1) != 0;
+    }
+
+    // Next state of a cell: 0 dead, 1 alive, 2 and up dying
+    int GetNextState(int state, int neighbors) const {
+        if (state == 0)
+            return GetNext(false, neighbors) ? 1 : 0;
+        if (state == 1)
+            return GetNext(true, neighbors) ? 1 : (m_StateCount > 2 ? 2 : 0);
+        return state + 1 < m_StateCount ? state + 1 : 0;
+    }
+
+    uint16_t GetBirthMask() const { return m_Birth; }
+    uint16_t GetSurvivalMask() const { return m_Survival; }
+    int GetStateCount() const { return m_StateCount; }
+
+    // Bits needed to store the oldest dying state's age, 1 through StateCount - 2
+    int GetAgePlaneCount() const {
+        int planes = 0;
+        while ((m_StateCount - 2) >> planes)
+            planes++;
+        return planes;
+    }
+
+    // With B0, empty space comes alive, so there's no such thing as a finite pattern
+    bool IsBirthOnZero() const { return (m_Birth & 1) != 0; }
+
+    bool operator==(const Rule& other) const {
+        return m_Birth == other.m_Birth && m_Survival == other.m_Survival && m_StateCount == other.m_StateCount;
+    }
+    bool operator!=(const Rule& other) const { return !(*this == other); }
+
+private:
+    static constexpr uint16_t AllCounts = 0x1FF;
+
+    // 8 bytes in all, so that a std::atomic<Rule> is lock free
+    uint16_t m_Birth{ 1 << 3 };
+    uint16_t m_Survival{ (1 << 2) | (1 << 3) };
+    int32_t m_StateCount{ 2 };
+};
+
+// Well known rules, for picking from a list
+struct NamedRule {
+    const char* Name;
+    const char* Notation;
+};
+
+extern const NamedRule KnownRules[];
+extern const size_t KnownRuleCount;
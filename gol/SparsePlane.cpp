@@ -0,0 +1,268 @@
+#include "SparsePlane.hpp"
+
+#include <algorithm>
+
+// Tiles handed to a worker at a time. Small planes are stepped by a single thread.
+static constexpr size_t TilesPerJob = 16;
+
+// Freed tiles are compacted away once they outnumber the tiles in use by this much
+static constexpr size_t MinCompactedTiles = 1024;
+
+size_t SparsePlane::KeyHash::operator()(uint64_t key) const {
+    key *= 0x9E3779B97F4A7C15ull;
+    key ^= key >> 29;
+    return size_t(key);
+}
+
+uint32_t SparsePlane::FindTile(int32_t x, int32_t y) const {
+    auto it = m_Index.find(GetKey(x, y));
+    return it == m_Index.end() ? NoTile : it->second;
+}
+
+uint32_t SparsePlane::AddTile(int32_t x, int32_t y) {
+    uint32_t tile;
+    if (!m_FreeTiles.empty()) {
+        tile = m_FreeTiles.back();
+        m_FreeTiles.pop_back();
+        std::fill(GetWords(tile, 0), GetWords(tile, 0) + 2 * m_TileWords, 0);
+    } else {
+        tile = uint32_t(m_Tiles.size());
+        m_Tiles.push_back({});
+        m_Words.resize(m_Words.size() + 2 * m_TileWords, 0);
+    }
+
+    Tile& added = m_Tiles[tile];
+    added.X = x;
+    added.Y = y;
+    added.IsChanged = false;
+    for (int i = 0; i < NeighborCount; i++) {
+        uint32_t neighbor = FindTile(x + NeighborX[i], y + NeighborY[i]);
+        added.Neighbors[i] = neighbor;
+        if (neighbor != NoTile)
+            m_Tiles[neighbor].Neighbors[NeighborCount - 1 - i] = tile;
+    }
+    m_Index.emplace(GetKey(x, y), tile);
+    return tile;
+}
+
+void SparsePlane::FreeTile(uint32_t tile) {
+    Tile& freed = m_Tiles[tile];
+    for (int i = 0; i < NeighborCount; i++) {
+        if (freed.Neighbors[i] != NoTile)
+            m_Tiles[freed.Neighbors[i]].Neighbors[NeighborCount - 1 - i] = NoTile;
+        freed.Neighbors[i] = NoTile;
+    }
+    freed.IsChanged = false;
+    m_Index.erase(GetKey(freed.X, freed.Y));
+    m_FreeTiles.push_back(tile);
+}
+
+bool SparsePlane::IsEmpty(uint32_t tile) const {
+    const CellWord* words = GetWords(tile, m_Front);
+    return std::all_of(words, words + m_TileWords, [](CellWord word) { return word == 0; });
+}
+
+// A cell can only be born next to a live one, so the tiles that have to exist around a tile
+// are the ones its live edge cells touch. Dying cells don't count as neighbors.
+void SparsePlane::AddMissingNeighbors(uint32_t tile) {
+    const uint32_t* neighbors = m_Tiles[tile].Neighbors;
+    if (std::find(neighbors, neighbors + NeighborCount, NoTile) == neighbors + NeighborCount)
+        return;
+
+    const CellWord* rows = GetWords(tile, m_Front);
+    CellWord top = rows[0];
+    CellWord bottom = rows[TileSize - 1];
+    CellWord left = 0;
+    CellWord right = 0;
+    for (size_t y = 0; y < TileSize; y++) {
+        left |= rows[y] & 1;
+        right |= rows[y] >> (CellsPerWord - 1);
+    }
+
+    bool touched[NeighborCount] = {
+        (top & 1) != 0, top != 0, (top >> (CellsPerWord - 1)) != 0,
+        left != 0, right != 0,
+        (bottom & 1) != 0, bottom != 0, (bottom >> (CellsPerWord - 1)) != 0,
+    };
+
+    // Adding tiles may move the words, and the tiles themselves
+    for (int i = 0; i < NeighborCount; i++) {
+        if (touched[i] && m_Tiles[tile].Neighbors[i] == NoTile)
+            AddTile(m_Tiles[tile].X + NeighborX[i], m_Tiles[tile].Y + NeighborY[i]);
+    }
+}
+
+void SparsePlane::Import(const BoardState& board) {
+    m_Tiles.clear();
+    m_Words.clear();
+    m_FreeTiles.clear();
+    m_Index.clear();
+    m_Front = 0;
+
+    // Tiles of the board line up with the plane's, as long as the board has the plane's age planes
+    int planes = board.GetAgePlaneCount() == m_AgePlanes ? m_AgePlanes : 0;
+    size_t height = board.GetHeight();
+    for (size_t ty = 0; ty < board.GetTileRows(); ty++) {
+        size_t rows = std::min(TileSize, height - ty * TileSize);
+        for (size_t tx = 0; tx < board.GetTileColumns(); tx++) {
+            bool isEmpty = true;
+            for (size_t r = 0; r < rows && isEmpty; r++) {
+                size_t y = ty * TileSize + r;
+                isEmpty = board.GetRow(y)[tx] == 0;
+                for (int plane = 0; plane < planes; plane++)
+                    isEmpty = isEmpty && board.GetAgeRow(plane, y)[tx] == 0;
+            }
+            if (isEmpty)
+                continue;
+
+            uint32_t tile = AddTile(int32_t(tx), int32_t(ty));
+            CellWord* words = GetWords(tile, m_Front);
+            for (size_t r = 0; r < rows; r++) {
+                size_t y = ty * TileSize + r;
+                words[r] = board.GetRow(y)[tx];
+                for (int plane = 0; plane < planes; plane++)
+                    words[(plane + 1) * TileSize + r] = board.GetAgeRow(plane, y)[tx];
+            }
+            m_Tiles[tile].IsChanged = true;
+        }
+    }
+}
+
+void SparsePlane::Export(BoardState& board) const {
+    int planes = std::min(board.GetAgePlaneCount(), m_AgePlanes);
+    size_t height = board.GetHeight();
+    size_t last = board.GetStride() - 1;
+    for (size_t ty = 0; ty < board.GetTileRows(); ty++) {
+        size_t rows = std::min(TileSize, height - ty * TileSize);
+        for (size_t tx = 0; tx < board.GetTileColumns(); tx++) {
+            uint32_t tile = FindTile(int32_t(tx), int32_t(ty));
+            const CellWord* words = tile == NoTile ? nullptr : GetWords(tile, m_Front);
+            CellWord mask = tx == last ? board.GetLastWordMask() : ~CellWord(0);
+            for (size_t r = 0; r < rows; r++) {
+                size_t y = ty * TileSize + r;
+                board.GetMutRow(y)[tx] = words ? words[r] & mask : 0;
+                for (int plane = 0; plane < planes; plane++)
+                    board.GetMutAgeRow(plane, y)[tx] = words ? words[(plane + 1) * TileSize + r] & mask : 0;
+            }
+
+            // Missing tiles were empty for the last two generations, or they would still be around
+            board.SetTileChanged(tx, ty, tile != NoTile && m_Tiles[tile].IsChanged);
+        }
+    }
+    board.InvalidateDensityPyramid();
+}
+
+void SparsePlane::SetRule(const Rule& rule) {
+    if (rule == m_Rule)
+        return;
+    m_Rule = rule;
+
+    if (rule.GetAgePlaneCount() != m_AgePlanes) {
+        // Only the live cells of the current generation carry over to the new layout
+        size_t tileWords = TileSize * size_t(1 + rule.GetAgePlaneCount());
+        std::vector<CellWord, BoardAllocator<CellWord>> words(m_Tiles.size() * 2 * tileWords, 0);
+        for (uint32_t tile = 0; tile < m_Tiles.size(); tile++)
+            std::copy(GetWords(tile, m_Front), GetWords(tile, m_Front) + TileSize, &words[size_t(tile) * 2 * tileWords]);
+        m_Words.swap(words);
+        m_AgePlanes = rule.GetAgePlaneCount();
+        m_TileWords = tileWords;
+        m_Front = 0;
+    }
+
+    // The tiles that were left alone aren't known to be stable under the new rule
+    for (const auto& entry : m_Index)
+        m_Tiles[entry.second].IsChanged = true;
+}
+
+void SparsePlane::Step(WorkerPool& pool) {
+    // Tiles added here start out empty and unchanged, so they don't need to be visited
+    size_t tileCount = m_Tiles.size();
+    for (uint32_t tile = 0; tile < tileCount; tile++) {
+        if (m_Tiles[tile].IsChanged)
+            AddMissingNeighbors(tile);
+    }
+
+    // Tiles that didn't change, and whose neighbors didn't either, stay as they are. Their
+    // back buffers already hold the same cells as the front ones.
+    m_ActiveTiles.clear();
+    for (uint32_t tile = 0; tile < m_Tiles.size(); tile++) {
+        const Tile& current = m_Tiles[tile];
+        bool isActive = current.IsChanged;
+        for (int i = 0; i < NeighborCount && !isActive; i++)
+            isActive = current.Neighbors[i] != NoTile && m_Tiles[current.Neighbors[i]].IsChanged;
+        if (isActive)
+            m_ActiveTiles.push_back(tile);
+    }
+
+    int back = 1 - m_Front;
+    m_Steps.clear();
+    for (uint32_t tile : m_ActiveTiles) {
+        PlaneTileStep step{};
+        for (int i = 0; i < NeighborCount; i++) {
+            uint32_t neighbor = m_Tiles[tile].Neighbors[i];
+            step.Neighborhood[i < 4 ? i : i + 1] = neighbor == NoTile ? nullptr : GetWords(neighbor, m_Front);
+        }
+        step.Neighborhood[4] = GetWords(tile, m_Front);
+        step.Out = GetWords(tile, back);
+        m_Steps.push_back(step);
+    }
+
+    // Each step only writes its own tile
+    size_t jobs = (m_Steps.size() + TilesPerJob - 1) / TilesPerJob;
+    auto stepJob = [&](size_t job) {
+        size_t begin = job * TilesPerJob;
+        size_t end = std::min(begin + TilesPerJob, m_Steps.size());
+        StepPlaneTiles(&m_Steps[begin], end - begin, m_Rule);
+    };
+    pool.Run(jobs, stepJob);
+
+    m_Front = back;
+    for (size_t i = 0; i < m_ActiveTiles.size(); i++)
+        m_Tiles[m_ActiveTiles[i]].IsChanged = m_Steps[i].IsChanged;
+
+    // Empty tiles are only freed once they stop changing, so that their neighbors still get
+    // stepped in the generation after one of them died out
+    for (uint32_t tile : m_ActiveTiles) {
+        if (!m_Tiles[tile].IsChanged && IsEmpty(tile))
+            FreeTile(tile);
+    }
+    m_LastSteppedTiles = m_ActiveTiles.size();
+
+    if (m_FreeTiles.size() > m_Index.size() + MinCompactedTiles)
+        Compact();
+}
+
+// Moves the tiles in use to the front, in a fresh and smaller allocation
+void SparsePlane::Compact() {
+    std::vector<uint32_t> moved(m_Tiles.size(), NoTile);
+    std::vector<Tile> tiles;
+    std::vector<CellWord, BoardAllocator<CellWord>> words(m_Index.size() * 2 * m_TileWords);
+    tiles.reserve(m_Index.size());
+    for (auto& entry : m_Index) {
+        uint32_t tile = entry.second;
+        moved[tile] = uint32_t(tiles.size());
+        entry.second = moved[tile];
+        std::copy(GetWords(tile, 0), GetWords(tile, 0) + 2 * m_TileWords, &words[size_t(moved[tile]) * 2 * m_TileWords]);
+        tiles.push_back(m_Tiles[tile]);
+    }
+    for (Tile& tile : tiles) {
+        for (uint32_t& neighbor : tile.Neighbors) {
+            if (neighbor != NoTile)
+                neighbor = moved[neighbor];
+        }
+    }
+
+    m_Tiles.swap(tiles);
+    m_Words.swap(words);
+    m_FreeTiles.clear();
+}
+
+uint64_t SparsePlane::GetPopulation() const {
+    uint64_t population = 0;
+    for (const auto& entry : m_Index) {
+        const CellWord* rows = GetWords(entry.second, m_Front);
+        for (size_t y = 0; y < TileSize; y++)
+            population += CountCells(rows[y]);
+    }
+    return population;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "BoardState.hpp"
+#include "Rule.hpp"
+#include "StepKernel.hpp"
+#include "WorkerPool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Unbounded plane made of 64x64 tiles, kept in a hash map by their coordinates. Tiles are
+// allocated as cells come near them and freed once they're empty and stay that way, so memory
+// follows the live population rather than the pattern's bounding box. Each generation only the
+// tiles next to a change are stepped, with the same kernels as the board.
+//
+// Like HashLife the plane doesn't wrap around. A board is mapped onto it with its top left
+// corner at the origin, and only that window is written back on export.
+class SparsePlane {
+public:
+    SparsePlane() = default;
+    SparsePlane(const SparsePlane&) = delete;
+    SparsePlane& operator=(const SparsePlane&) = delete;
+
+    // Replaces the plane with the contents of the board, ages included
+    void Import(const BoardState& board);
+
+    // Writes the cells inside the board's window onto it, and flags the board's tiles that
+    // changed in the last generation. The board must have the plane's age planes.
+    void Export(BoardState& board) const;
+
+    // Advances the plane by one generation, stepping the tiles in parallel on the pool
+    void Step(WorkerPool& pool);
+
+    // Rules with B0 would fill the infinite empty plane in one step, so they can't be used
+    static bool SupportsRule(const Rule& rule) { return !rule.IsBirthOnZero(); }
+
+    // The rule must be supported. When it changes every tile is stepped again, and if it
+    // needs another number of age planes the dying cells are dropped.
+    void SetRule(const Rule& rule);
+    const Rule& GetRule() const { return m_Rule; }
+
+    uint64_t GetPopulation() const;
+    size_t GetTileCount() const { return m_Index.size(); }
+
+    // Tiles stepped by the last Step, the others were left alone
+    size_t GetLastSteppedTileCount() const { return m_LastSteppedTiles; }
+
+    // Bytes held for the tiles' cells, including freed tiles kept around for reuse
+    size_t GetAllocatedBytes() const { return m_Words.capacity() * sizeof(CellWord); }
+
+private:
+    static constexpr uint32_t NoTile = UINT32_MAX;
+
+    // Neighbors are in row major order, so the opposite of neighbor i is neighbor 7 - i
+    static constexpr int NeighborCount = 8;
+    static constexpr int NeighborX[NeighborCount] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+    static constexpr int NeighborY[NeighborCount] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+
+    struct Tile {
+        int32_t X;
+        int32_t Y;
+        uint32_t Neighbors[NeighborCount];
+        // Whether the tile changed in the last generation
+        bool IsChanged;
+    };
+
+    static uint64_t GetKey(int32_t x, int32_t y) { return (uint64_t(uint32_t(x)) << 32) | uint32_t(y); }
+
+    struct KeyHash {
+        size_t operator()(uint64_t key) const;
+    };
+
+    // Each tile has two buffers, the current generation and the previous one, which
+    // swap roles every generation
+    CellWord* GetWords(uint32_t tile, int buffer) { return &m_Words[(size_t(tile) * 2 + buffer) * m_TileWords]; }
+    const CellWord* GetWords(uint32_t tile, int buffer) const { return &m_Words[(size_t(tile) * 2 + buffer) * m_TileWords]; }
+
+    uint32_t FindTile(int32_t x, int32_t y) const;
+    uint32_t AddTile(int32_t x, int32_t y);
+    void FreeTile(uint32_t tile);
+    void AddMissingNeighbors(uint32_t tile);
+    bool IsEmpty(uint32_t tile) const;
+    void Compact();
+
+    Rule m_Rule{};
+    int m_AgePlanes{ 0 };
+    size_t m_TileWords{ TileSize };
+    int m_Front{ 0 };
+    size_t m_LastSteppedTiles{ 0 };
+
+    std::vector<Tile> m_Tiles{};
+    std::vector<CellWord, BoardAllocator<CellWord>> m_Words{};
+    std::vector<uint32_t> m_FreeTiles{};
+    std::unordered_map<uint64_t, uint32_t, KeyHash> m_Index{};
+
+    // Per generation lists of the tiles being stepped, kept to avoid reallocating them
+    std::vector<uint32_t> m_ActiveTiles{};
+    std::vector<PlaneTileStep> m_Steps{};
+};
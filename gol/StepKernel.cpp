@@ -0,0 +1,782 @@
+#include "StepKernel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define GOL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define GOL_X86 0
+#endif
+
+// MSVC accepts any intrinsic without extra flags, GCC and Clang need the target
+// enabled on each function using it
+#if GOL_X86 && !defined(_MSC_VER)
+#define GOL_TARGET(name) __attribute__((target(name)))
+#else
+#define GOL_TARGET(name)
+#endif
+
+// A rule compiled for the bit sliced kernels. Every neighbor count that leads to a live cell
+// becomes a term holding the count's 4 bits, each as an all ones or all zeros word to compare
+// the computed count bits against, and masks of the states (dead, alive) the term applies to.
+// Generations rules also get the bits of the oldest dying state's age, in the same form.
+struct RuleTerms {
+    int Count{ 0 };
+    CellWord Bits[9][4]{};
+    CellWord ForDead[9]{};
+    CellWord ForAlive[9]{};
+    int AgePlanes{ 0 };
+    CellWord LastAge[MaxAgePlanes]{};
+};
+
+static constexpr RuleTerms CompileRuleTerms(uint16_t birthMask, uint16_t survivalMask) {
+    RuleTerms terms{};
+    for (int count = 0; count <= 8; count++) {
+        bool isBirth = ((birthMask >> count) & 1) != 0;
+        bool isSurvival = ((survivalMask >> count) & 1) != 0;
+        if (!isBirth && !isSurvival)
+            continue;
+        for (int bit = 0; bit < 4; bit++)
+            terms.Bits[terms.Count][bit] = ((count >> bit) & 1) ? ~CellWord(0) : 0;
+        terms.ForDead[terms.Count] = isBirth ? ~CellWord(0) : 0;
+        terms.ForAlive[terms.Count] = isSurvival ? ~CellWord(0) : 0;
+        terms.Count++;
+    }
+    return terms;
+}
+
+static RuleTerms CompileRuleTerms(const Rule& rule) {
+    RuleTerms terms = CompileRuleTerms(rule.GetBirthMask(), rule.GetSurvivalMask());
+    terms.AgePlanes = rule.GetAgePlaneCount();
+    for (int plane = 0; plane < terms.AgePlanes; plane++)
+        terms.LastAge[plane] = (((rule.GetStateCount() - 2) >> plane) & 1) ? ~CellWord(0) : 0;
+    return terms;
+}
+
+// How the kernels turn neighbor counts into the next generation. Conway's rule combines the
+// adder network's outputs directly, which no other rule can. Other common rules get their
+// terms fixed at compile time, so the term loop unrolls and folds into plain logic, and
+// anything else reads the terms at run time. Generations rules read them at run time too,
+// and step the age planes along with the live cells.
+struct ConwayRule {};
+
+template <uint16_t BirthMask, uint16_t SurvivalMask>
+struct FixedRule {
+    static constexpr RuleTerms Terms = CompileRuleTerms(BirthMask, SurvivalMask);
+};
+
+struct TableRule {};
+
+struct GenerationsRule {};
+
+template <typename RuleType>
+constexpr bool HasAges = std::is_same<RuleType, GenerationsRule>::value;
+
+template <typename RuleType>
+static inline const RuleTerms& SelectTerms(const RuleTerms& runtimeTerms) {
+    if constexpr (std::is_same<RuleType, TableRule>::value || HasAges<RuleType>)
+        return runtimeTerms;
+    else
+        return RuleType::Terms;
+}
+
+// Adds three bit vectors, producing the low (sum) and high (carry) bit of each column's count
+static inline void FullAdd(CellWord a, CellWord b, CellWord c, CellWord& sum, CellWord& carry) {
+    CellWord t = a ^ b;
+    sum = t ^ c;
+    carry = (a & b) | (t & c);
+}
+
+// Computes the next state of 64 cells at once, given the word holding them and its 8 neighbors,
+// each already shifted so that bit i of every input lines up with bit i of the output.
+template <typename RuleType>
+static inline CellWord NextWord(
+    CellWord nw, CellWord n, CellWord ne,
+    CellWord w, CellWord c, CellWord e,
+    CellWord sw, CellWord s, CellWord se,
+    const RuleTerms& runtimeTerms
+) {
+    CellWord sumN, carryN, sumS, carryS;
+    FullAdd(nw, n, ne, sumN, carryN);
+    FullAdd(sw, s, se, sumS, carryS);
+    CellWord sumM = w ^ e;
+    CellWord carryM = w & e;
+
+    // ones is the 1s bit of the neighbor count, the four carries are worth 2 each
+    CellWord ones, carryOnes;
+    FullAdd(sumN, sumS, sumM, ones, carryOnes);
+
+    CellWord twosParity, twosMany;
+    FullAdd(carryN, carryS, carryM, twosParity, twosMany);
+
+    if constexpr (std::is_same<RuleType, ConwayRule>::value) {
+        // Exactly one carry set means the count is 2 or 3, anything else is under 2 or over 3
+        CellWord exactlyOneTwo = ~twosMany & (twosParity ^ carryOnes);
+        return exactlyOneTwo & (ones | c);
+    } else {
+        // The count is ones + 2 * (carryOnes + twosParity + 2 * twosMany), which is at most 8
+        CellWord bit1 = carryOnes ^ twosParity;
+        CellWord carry = carryOnes & twosParity;
+        CellWord bit2 = twosMany ^ carry;
+        CellWord bit3 = twosMany & carry;
+
+        const RuleTerms& terms = SelectTerms<RuleType>(runtimeTerms);
+        CellWord next = 0;
+        for (int i = 0; i < terms.Count; i++) {
+            CellWord miss = (ones ^ terms.Bits[i][0]) | (bit1 ^ terms.Bits[i][1])
+                | (bit2 ^ terms.Bits[i][2]) | (bit3 ^ terms.Bits[i][3]);
+            next |= ~miss & ((c & terms.ForAlive[i]) | (~c & terms.ForDead[i]));
+        }
+        return next;
+    }
+}
+
+// The nine input rows of one output row, the west and east ones being shifted halos.
+// Under Generations rules also the age planes of the center row and of the output row,
+// dying cells don't count as neighbors so no other rows' ages are needed.
+struct StepRowInputs {
+    const CellWord* NW;
+    const CellWord* N;
+    const CellWord* NE;
+    const CellWord* W;
+    const CellWord* C;
+    const CellWord* E;
+    const CellWord* SW;
+    const CellWord* S;
+    const CellWord* SE;
+    const CellWord* Ages[MaxAgePlanes];
+    CellWord* OutAges[MaxAgePlanes];
+};
+
+// Steps the words [begin, end) of a row into out, and flags the words that changed.
+// None of the words may be the masked last word of the row.
+typedef void (*StepWordsFunction)(const StepRowInputs& in, const RuleTerms& terms, CellWord* out, uint8_t* changed, size_t begin, size_t end);
+
+// Steps the single word i of a row, keeping only the cells in mask
+typedef void (*StepMaskedWordFunction)(const StepRowInputs& in, const RuleTerms& terms, CellWord* out, uint8_t* changed, size_t i, CellWord mask);
+
+// Ages the dying cells of word i by a generation, the oldest ones becoming dead, and starts
+// the cells that just died on their way out. Cells still dying can't be born, so they're
+// removed from next. Flags the word if any age changed.
+static inline CellWord StepAgesAt(const StepRowInputs& in, const RuleTerms& terms, size_t i, CellWord next, uint8_t& changed) {
+    CellWord dying = 0;
+    CellWord isLast = ~CellWord(0);
+    for (int plane = 0; plane < terms.AgePlanes; plane++) {
+        dying |= in.Ages[plane][i];
+        isLast &= ~(in.Ages[plane][i] ^ terms.LastAge[plane]);
+    }
+    next &= ~dying;
+    CellWord died = in.C[i] & ~next;
+
+    // Adding the dying cells to the ages, a bit plane at a time
+    CellWord carry = dying;
+    for (int plane = 0; plane < terms.AgePlanes; plane++) {
+        CellWord age = in.Ages[plane][i];
+        CellWord nextAge = ((age ^ carry) & ~isLast) | (plane == 0 ? died : 0);
+        carry &= age;
+        changed |= nextAge != age;
+        in.OutAges[plane][i] = nextAge;
+    }
+    return next;
+}
+
+template <typename RuleType>
+static inline void StepMaskedWord(const StepRowInputs& in, const RuleTerms& terms, CellWord* out, uint8_t* changed, size_t i, CellWord mask) {
+    CellWord next = NextWord<RuleType>(in.NW[i], in.N[i], in.NE[i], in.W[i], in.C[i], in.E[i], in.SW[i], in.S[i], in.SE[i], terms) & mask;
+    if constexpr (HasAges<RuleType>)
+        next = StepAgesAt(in, terms, i, next, changed[i]);
+    changed[i] |= next != in.C[i];
+    out[i] = next;
+}
+
+template <typename RuleType>
+static void StepWordsScalar(const StepRowInputs& in, const RuleTerms& terms, CellWord* out, uint8_t* changed, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+        StepMaskedWord<RuleType>(in, terms, out, changed, i, ~CellWord(0));
+}
+
+// Adds the cells set in next but not in current to births, and the other way around to deaths,
+// for the words [begin, end)
+typedef void (*CountChangesFunction)(const CellWord* current, const CellWord* next, size_t begin, size_t end, uint64_t& births, uint64_t& deaths);
+
+static void CountChangesScalar(const CellWord* current, const CellWord* next, size_t begin, size_t end, uint64_t& births, uint64_t& deaths) {
+    for (size_t i = begin; i < end; i++) {
+        births += CountCells(next[i] & ~current[i]);
+        deaths += CountCells(current[i] & ~next[i]);
+    }
+}
+
+#if GOL_X86
+
+// The vector kernels run the exact same adder network and rule logic as NextWord, just on
+// 2 or 4 words at a time, so their output is bit for bit the same.
+
+template <typename RuleType>
+GOL_TARGET("sse2")
+static inline __m128i ApplyRuleSse2(__m128i ones, __m128i carryOnes, __m128i twosParity, __m128i twosMany, __m128i c, const RuleTerms& runtimeTerms) {
+    if constexpr (std::is_same<RuleType, ConwayRule>::value) {
+        __m128i exactlyOneTwo = _mm_andnot_si128(twosMany, _mm_xor_si128(twosParity, carryOnes));
+        return _mm_and_si128(exactlyOneTwo, _mm_or_si128(ones, c));
+    } else {
+        __m128i bit1 = _mm_xor_si128(carryOnes, twosParity);
+        __m128i carry = _mm_and_si128(carryOnes, twosParity);
+        __m128i bit2 = _mm_xor_si128(twosMany, carry);
+        __m128i bit3 = _mm_and_si128(twosMany, carry);
+
+        const RuleTerms& terms = SelectTerms<RuleType>(runtimeTerms);
+        __m128i next = _mm_setzero_si128();
+        for (int i = 0; i < terms.Count; i++) {
+            __m128i miss = _mm_or_si128(
+                _mm_or_si128(_mm_xor_si128(ones, _mm_set1_epi64x(int64_t(terms.Bits[i][0]))), _mm_xor_si128(bit1, _mm_set1_epi64x(int64_t(terms.Bits[i][1])))),
+                _mm_or_si128(_mm_xor_si128(bit2, _mm_set1_epi64x(int64_t(terms.Bits[i][2]))), _mm_xor_si128(bit3, _mm_set1_epi64x(int64_t(terms.Bits[i][3])))));
+            __m128i states = _mm_or_si128(
+                _mm_and_si128(c, _mm_set1_epi64x(int64_t(terms.ForAlive[i]))),
+                _mm_andnot_si128(c, _mm_set1_epi64x(int64_t(terms.ForDead[i]))));
+            next = _mm_or_si128(next, _mm_andnot_si128(miss, states));
+        }
+        return next;
+    }
+}
+
+// StepAgesAt on 2 words, returning the bits of the ages that changed
+GOL_TARGET("sse2")
+static inline __m128i StepAgesSse2(const StepRowInputs& in, const RuleTerms& terms, size_t i, __m128i c, __m128i& next) {
+    __m128i ages[MaxAgePlanes];
+    __m128i dying = _mm_setzero_si128();
+    __m128i isLast = _mm_cmpeq_epi32(dying, dying);
+    for (int plane = 0; plane < terms.AgePlanes; plane++) {
+        ages[plane] = _mm_loadu_si128((const __m128i*)(in.Ages[plane] + i));
+        dying = _mm_or_si128(dying, ages[plane]);
+        isLast = _mm_andnot_si128(_mm_xor_si128(ages[plane], _mm_set1_epi64x(int64_t(terms.LastAge[plane]))), isLast);
+    }
+    next = _mm_andnot_si128(dying, next);
+    __m128i died = _mm_andnot_si128(next, c);
+
+    __m128i carry = dying;
+    __m128i changed = _mm_setzero_si128();
+    for (int plane = 0; plane < terms.AgePlanes; plane++) {
+        __m128i nextAge = _mm_andnot_si128(isLast, _mm_xor_si128(ages[plane], carry));
+        if (plane == 0)
+            nextAge = _mm_or_si128(nextAge, died);
+        carry = _mm_and_si128(carry, ages[plane]);
+        changed = _mm_or_si128(changed, _mm_xor_si128(nextAge, ages[plane]));
+        _mm_storeu_si128((__m128i*)(in.OutAges[plane] + i), nextAge);
+    }
+    return changed;
+}
+
+template <typename RuleType>
+GOL_TARGET("sse2")
+static void StepWordsSse2(const StepRowInputs& in, const RuleTerms& terms, CellWord* out, uint8_t* changed, size_t begin, size_t end) {
+    size_t i = begin;
+    for (; i + 2 <= end; i += 2) {
+        __m128i nw = _mm_loadu_si128((const __m128i*)(in.NW + i));
+        __m128i n = _mm_loadu_si128((const __m128i*)(in.N + i));
+        __m128i ne = _mm_loadu_si128((const __m128i*)(in.NE + i));
+        __m128i w = _mm_loadu_si128((const __m128i*)(in.W + i));
+        __m128i c = _mm_loadu_si128((const __m128i*)(in.C + i));
+        __m128i e = _mm_loadu_si128((const __m128i*)(in.E + i));
+        __m128i sw = _mm_loadu_si128((const __m128i*)(in.SW + i));
+        __m128i s = _mm_loadu_si128((const __m128i*)(in.S + i));
+        __m128i se = _mm_loadu_si128((const __m128i*)(in.SE + i));
+
+        __m128i t = _mm_xor_si128(nw, n);
+        __m128i sumN = _mm_xor_si128(t, ne);
+        __m128i carryN = _mm_or_si128(_mm_and_si128(nw, n), _mm_and_si128(t, ne));
+        t = _mm_xor_si128(sw, s);
+        __m128i sumS = _mm_xor_si128(t, se);
+        __m128i carryS = _mm_or_si128(_mm_and_si128(sw, s), _mm_and_si128(t, se));
+        __m128i sumM = _mm_xor_si128(w, e);
+        __m128i carryM = _mm_and_si128(w, e);
+
+        t = _mm_xor_si128(sumN, sumS);
+        __m128i ones = _mm_xor_si128(t, sumM);
+        __m128i carryOnes = _mm_or_si128(_mm_and_si128(sumN, sumS), _mm_and_si128(t, sumM));
+
+        t = _mm_xor_si128(carryN, carryS);
+        __m128i twosParity = _mm_xor_si128(t, carryM);
+        __m128i twosMany = _mm_or_si128(_mm_and_si128(carryN, carryS), _mm_and_si128(t, carryM));
+
+        __m128i next = ApplyRuleSse2<RuleType>(ones, carryOnes, twosParity, twosMany, c, terms);
+
+        // SSE2 has no 64 bit compare, a word is unchanged when both of its halves are
+        __m128i unchanged;
+        if constexpr (HasAges<RuleType>) {
+            __m128i agesChanged = StepAgesSse2(in, terms, i, c, next);
+            unchanged = _mm_cmpeq_epi32(_mm_or_si128(_mm_xor_si128(next, c), agesChanged), _mm_setzero_si128());
+        } else {
+            unchanged = _mm_cmpeq_epi32(next, c);
+        }
+        _mm_storeu_si128((__m128i*)(out + i), next);
+        int same = _mm_movemask_ps(_mm_castsi128_ps(unchanged));
+        changed[i + 0] |= (same & 0x3) != 0x3;
+        changed[i + 1] |= (same & 0xC) != 0xC;
+    }
+    StepWordsScalar<RuleType>(in, terms, out, changed, i, end);
+}
+
+template <typename RuleType>
+GOL_TARGET("avx2")
+static inline __m256i ApplyRuleAvx2(__m256i ones, __m256i carryOnes, __m256i twosParity, __m256i twosMany, __m256i c, const RuleTerms& runtimeTerms) {
+    if constexpr (std::is_same<RuleType, ConwayRule>::value) {
+        __m256i exactlyOneTwo = _mm256_andnot_si256(twosMany, _mm256_xor_si256(twosParity, carryOnes));
+        return _mm256_and_si256(exactlyOneTwo, _mm256_or_si256(ones, c));
+    } else {
+        __m256i bit1 = _mm256_xor_si256(carryOnes, twosParity);
+        __m256i carry = _mm256_and_si256(carryOnes, twosParity);
+        __m256i bit2 = _mm256_xor_si256(twosMany, carry);
+        __m256i bit3 = _mm256_and_si256(twosMany, carry);
+
+        const RuleTerms& terms = SelectTerms<RuleType>(runtimeTerms);
+        __m256i next = _mm256_setzero_si256();
+        for (int i = 0; i < terms.Count; i++) {
+            __m256i miss = _mm256_or_si256(
+                _mm256_or_si256(_mm256_xor_si256(ones, _mm256_set1_epi64x(int64_t(terms.Bits[i][0]))), _mm256_xor_si256(bit1, _mm256_set1_epi64x(int64_t(terms.Bits[i][1])))),
+                _mm256_or_si256(_mm256_xor_si256(bit2, _mm256_set1_epi64x(int64_t(terms.Bits[i][2]))), _mm256_xor_si256(bit3, _mm256_set1_epi64x(int64_t(terms.Bits[i][3])))));
+            __m256i states = _mm256_or_si256(
+                _mm256_and_si256(c, _mm256_set1_epi64x(int64_t(terms.ForAlive[i]))),
+                _mm256_andnot_si256(c, _mm256_set1_epi64x(int64_t(terms.ForDead[i]))));
+            next = _mm256_or_si256(next, _mm256_andnot_si256(miss, states));
+        }
+        return next;
+    }
+}
+
+GOL_TARGET("avx2")
+static inline __m256i StepAgesAvx2(const StepRowInputs& in, const RuleTerms& terms, size_t i, __m256i c, __m256i& next) {
+    __m256i ages[MaxAgePlanes];
+    __m256i dying = _mm256_setzero_si256();
+    __m256i isLast = _mm256_cmpeq_epi64(dying, dying);
+    for (int plane = 0; plane < terms.AgePlanes; plane++) {
+        ages[plane] = _mm256_loadu_si256((const __m256i*)(in.Ages[plane] + i));
+        dying = _mm256_or_si256(dying, ages[plane]);
+        isLast = _mm256_andnot_si256(_mm256_xor_si256(ages[plane], _mm256_set1_epi64x(int64_t(terms.LastAge[plane]))), isLast);
+    }
+    next = _mm256_andnot_si256(dying, next);
+    __m256i died = _mm256_andnot_si256(next, c);
+
+    __m256i carry = dying;
+    __m256i changed = _mm256_setzero_si256();
+    for (int plane = 0; plane < terms.AgePlanes; plane++) {
+        __m256i nextAge = _mm256_andnot_si256(isLast, _mm256_xor_si256(ages[plane], carry));
+        if (plane == 0)
+            nextAge = _mm256_or_si256(nextAge, died);
+        carry = _mm256_and_si256(carry, ages[plane]);
+        changed = _mm256_or_si256(changed, _mm256_xor_si256(nextAge, ages[plane]));
+        _mm256_storeu_si256((__m256i*)(in.OutAges[plane] + i), nextAge);
+    }
+    return changed;
+}
+
+template <typename RuleType>
+GOL_TARGET("avx2")
+static void StepWordsAvx2(const StepRowInputs& in, const RuleTerms& terms, CellWord* out, uint8_t* changed, size_t begin, size_t end) {
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m256i nw = _mm256_loadu_si256((const __m256i*)(in.NW + i));
+        __m256i n = _mm256_loadu_si256((const __m256i*)(in.N + i));
+        __m256i ne = _mm256_loadu_si256((const __m256i*)(in.NE + i));
+        __m256i w = _mm256_loadu_si256((const __m256i*)(in.W + i));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(in.C + i));
+        __m256i e = _mm256_loadu_si256((const __m256i*)(in.E + i));
+        __m256i sw = _mm256_loadu_si256((const __m256i*)(in.SW + i));
+        __m256i s = _mm256_loadu_si256((const __m256i*)(in.S + i));
+        __m256i se = _mm256_loadu_si256((const __m256i*)(in.SE + i));
+
+        __m256i t = _mm256_xor_si256(nw, n);
+        __m256i sumN = _mm256_xor_si256(t, ne);
+        __m256i carryN = _mm256_or_si256(_mm256_and_si256(nw, n), _mm256_and_si256(t, ne));
+        t = _mm256_xor_si256(sw, s);
+        __m256i sumS = _mm256_xor_si256(t, se);
+        __m256i carryS = _mm256_or_si256(_mm256_and_si256(sw, s), _mm256_and_si256(t, se));
+        __m256i sumM = _mm256_xor_si256(w, e);
+        __m256i carryM = _mm256_and_si256(w, e);
+
+        t = _mm256_xor_si256(sumN, sumS);
+        __m256i ones = _mm256_xor_si256(t, sumM);
+        __m256i carryOnes = _mm256_or_si256(_mm256_and_si256(sumN, sumS), _mm256_and_si256(t, sumM));
+
+        t = _mm256_xor_si256(carryN, carryS);
+        __m256i twosParity = _mm256_xor_si256(t, carryM);
+        __m256i twosMany = _mm256_or_si256(_mm256_and_si256(carryN, carryS), _mm256_and_si256(t, carryM));
+
+        __m256i next = ApplyRuleAvx2<RuleType>(ones, carryOnes, twosParity, twosMany, c, terms);
+
+        __m256i unchanged;
+        if constexpr (HasAges<RuleType>) {
+            __m256i agesChanged = StepAgesAvx2(in, terms, i, c, next);
+            unchanged = _mm256_cmpeq_epi64(_mm256_or_si256(_mm256_xor_si256(next, c), agesChanged), _mm256_setzero_si256());
+        } else {
+            unchanged = _mm256_cmpeq_epi64(next, c);
+        }
+        _mm256_storeu_si256((__m256i*)(out + i), next);
+        int same = _mm256_movemask_pd(_mm256_castsi256_pd(unchanged));
+        changed[i + 0] |= (same & 1) == 0;
+        changed[i + 1] |= (same & 2) == 0;
+        changed[i + 2] |= (same & 4) == 0;
+        changed[i + 3] |= (same & 8) == 0;
+    }
+    StepWordsScalar<RuleType>(in, terms, out, changed, i, end);
+}
+
+// Popcounts nibbles through a lookup table and sums the bytes with SAD, which beats POPCNT one
+// word at a time by about 3x
+GOL_TARGET("avx2")
+static inline __m256i CountCellsAvx2(__m256i words) {
+    const __m256i nibbleCounts = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowNibbles = _mm256_set1_epi8(0x0F);
+    __m256i low = _mm256_shuffle_epi8(nibbleCounts, _mm256_and_si256(words, lowNibbles));
+    __m256i high = _mm256_shuffle_epi8(nibbleCounts, _mm256_and_si256(_mm256_srli_epi16(words, 4), lowNibbles));
+    return _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256());
+}
+
+GOL_TARGET("avx2")
+static void CountChangesAvx2(const CellWord* current, const CellWord* next, size_t begin, size_t end, uint64_t& births, uint64_t& deaths) {
+    __m256i birthCounts = _mm256_setzero_si256();
+    __m256i deathCounts = _mm256_setzero_si256();
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + i));
+        __m256i n = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(next + i));
+        birthCounts = _mm256_add_epi64(birthCounts, CountCellsAvx2(_mm256_andnot_si256(c, n)));
+        deathCounts = _mm256_add_epi64(deathCounts, CountCellsAvx2(_mm256_andnot_si256(n, c)));
+    }
+
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), birthCounts);
+    births += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), deathCounts);
+    deaths += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    CountChangesScalar(current, next, i, end, births, deaths);
+}
+
+static bool CpuSupportsAvx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    // The OS has to save the YMM registers too, not just the CPU support the instructions
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+static KernelLevel DetectKernelLevel() {
+#if GOL_X86
+    if (CpuSupportsAvx2())
+        return KernelLevel::Avx2;
+    // Every x86-64 CPU has SSE2, 32 bit builds are assumed to run on one that does too
+    return KernelLevel::Sse2;
+#else
+    return KernelLevel::Scalar;
+#endif
+}
+
+static std::atomic<KernelLevel>& ActiveKernelLevel() {
+    static std::atomic<KernelLevel> level{ GetSupportedKernelLevel() };
+    return level;
+}
+
+KernelLevel GetSupportedKernelLevel() {
+    static const KernelLevel supported = DetectKernelLevel();
+    return supported;
+}
+
+KernelLevel GetKernelLevel() {
+    return ActiveKernelLevel();
+}
+
+void SetKernelLevel(KernelLevel level) {
+    ActiveKernelLevel() = std::min(level, GetSupportedKernelLevel());
+}
+
+const char* GetKernelLevelName(KernelLevel level) {
+    switch (level) {
+    case KernelLevel::Scalar: return "scalar";
+    case KernelLevel::Sse2: return "SSE2";
+    case KernelLevel::Avx2: return "AVX2";
+    }
+    return "unknown";
+}
+
+// Kernels for one rule and instruction set. SSE2 has no byte shuffle, so it counts
+// changes one word at a time.
+struct RuleKernels {
+    StepWordsFunction StepWords;
+    StepMaskedWordFunction StepMaskedWord;
+    CountChangesFunction CountChanges;
+};
+
+template <typename RuleType>
+static RuleKernels GetRuleKernels(KernelLevel level) {
+#if GOL_X86
+    switch (level) {
+    case KernelLevel::Avx2: return { StepWordsAvx2<RuleType>, StepMaskedWord<RuleType>, CountChangesAvx2 };
+    case KernelLevel::Sse2: return { StepWordsSse2<RuleType>, StepMaskedWord<RuleType>, CountChangesScalar };
+    default: break;
+    }
+#endif
+    return { StepWordsScalar<RuleType>, StepMaskedWord<RuleType>, CountChangesScalar };
+}
+
+static constexpr uint16_t CountMask(std::initializer_list<int> counts) {
+    uint16_t mask = 0;
+    for (int count : counts)
+        mask |= uint16_t(1 << count);
+    return mask;
+}
+
+// Rules common enough to get kernels of their own, the rest share the run time table kernels
+typedef FixedRule<CountMask({ 3, 6 }), CountMask({ 2, 3 })> HighLifeRule;
+typedef FixedRule<CountMask({ 3, 6, 7, 8 }), CountMask({ 3, 4, 6, 7, 8 })> DayAndNightRule;
+typedef FixedRule<CountMask({ 2 }), 0> SeedsRule;
+
+static RuleKernels GetKernels(KernelLevel level, const Rule& rule) {
+    uint16_t birth = rule.GetBirthMask();
+    uint16_t survival = rule.GetSurvivalMask();
+    if (rule.GetStateCount() > 2)
+        return GetRuleKernels<GenerationsRule>(level);
+    if (rule == Rule())
+        return GetRuleKernels<ConwayRule>(level);
+    if (birth == CountMask({ 3, 6 }) && survival == CountMask({ 2, 3 }))
+        return GetRuleKernels<HighLifeRule>(level);
+    if (birth == CountMask({ 3, 6, 7, 8 }) && survival == CountMask({ 3, 4, 6, 7, 8 }))
+        return GetRuleKernels<DayAndNightRule>(level);
+    if (birth == CountMask({ 2 }) && survival == 0)
+        return GetRuleKernels<SeedsRule>(level);
+    return GetRuleKernels<TableRule>(level);
+}
+
+// Fills west/east with the row shifted by one cell in each direction, for the words of the
+// given runs. The wraparound only ever affects the first and last word, so it's handled
+// outside of the loops.
+static void ComputeHalo(const BoardState& board, size_t y, const std::vector<TileRun>& runs, CellWord* west, CellWord* east) {
+    const CellWord* row = board.GetRow(y);
+    size_t last = board.GetStride() - 1;
+    size_t lastBit = (board.GetWidth() - 1) % CellsPerWord;
+
+    for (const TileRun& run : runs) {
+        size_t i = run.Begin;
+        if (i == 0) {
+            west[0] = (row[0] << 1) | ((row[last] >> lastBit) & 1);
+            i++;
+        }
+        for (; i < run.End; i++)
+            west[i] = (row[i] << 1) | (row[i - 1] >> (CellsPerWord - 1));
+
+        size_t eastEnd = std::min(run.End, last);
+        for (i = run.Begin; i < eastEnd; i++)
+            east[i] = (row[i] >> 1) | (row[i + 1] << (CellsPerWord - 1));
+        if (run.End > last)
+            east[last] = (row[last] >> 1) | ((row[0] & 1) << lastBit);
+    }
+}
+
+void StepScratch::Prepare(const BoardState& board) {
+    m_Stride = board.GetStride();
+    if (m_Words.size() != SlotCount * 2 * m_Stride) {
+        m_Words.assign(SlotCount * 2 * m_Stride, 0);
+        m_ActiveTiles.assign(m_Stride, 0);
+        m_ChangedTiles.assign(m_Stride, 0);
+        m_Runs.reserve(m_Stride);
+    }
+    Invalidate();
+    ActiveTileCount = 0;
+    Births = 0;
+    Deaths = 0;
+}
+
+void StepScratch::Invalidate() {
+    for (size_t& row : m_Rows)
+        row = NoRow;
+}
+
+size_t StepScratch::FetchRow(const BoardState& board, size_t y, size_t keepA, size_t keepB) {
+    for (size_t slot = 0; slot < SlotCount; slot++) {
+        if (m_Rows[slot] == y)
+            return slot;
+    }
+
+    size_t slot = 0;
+    while (m_Rows[slot] == keepA || m_Rows[slot] == keepB)
+        slot++;
+
+    m_Rows[slot] = y;
+    ComputeHalo(board, y, m_Runs, &m_Words[(slot * 2 + 0) * m_Stride], &m_Words[(slot * 2 + 1) * m_Stride]);
+    return slot;
+}
+
+// Finds the tiles of a tile row that have a changed tile in their 3x3 neighborhood,
+// and groups them into runs of adjacent tiles. Returns how many tiles are active.
+size_t StepScratch::FindActiveTiles(const BoardState& src, size_t ty) {
+    size_t columns = src.GetTileColumns();
+    size_t rows = src.GetTileRows();
+    size_t tyAbove = ty == 0 ? rows - 1 : ty - 1;
+    size_t tyBelow = ty == rows - 1 ? 0 : ty + 1;
+    uint8_t* active = m_ActiveTiles.data();
+
+    // Collapse the three rows first, then spread each column to its horizontal neighbors
+    for (size_t tx = 0; tx < columns; tx++)
+        active[tx] = src.IsTileChanged(tx, tyAbove) | src.IsTileChanged(tx, ty) | src.IsTileChanged(tx, tyBelow);
+
+    uint8_t first = active[0];
+    uint8_t previous = active[columns - 1];
+    for (size_t tx = 0; tx < columns; tx++) {
+        uint8_t current = active[tx];
+        uint8_t next = tx + 1 < columns ? active[tx + 1] : first;
+        active[tx] = previous | current | next;
+        previous = current;
+    }
+
+    m_Runs.clear();
+    size_t count = 0;
+    for (size_t tx = 0; tx < columns;) {
+        if (!active[tx]) {
+            tx++;
+            continue;
+        }
+        size_t begin = tx;
+        while (tx < columns && active[tx])
+            tx++;
+        m_Runs.push_back({ begin, tx });
+        count += tx - begin;
+    }
+    return count;
+}
+
+void StepTileRows(const BoardState& src, BoardState& dst, size_t tyBegin, size_t tyEnd, StepScratch& scratch, const Rule& rule) {
+    size_t height = src.GetHeight();
+    size_t stride = src.GetStride();
+    size_t last = stride - 1;
+    CellWord lastMask = src.GetLastWordMask();
+    uint8_t* changed = scratch.GetChangedTiles();
+    RuleKernels kernels = GetKernels(GetKernelLevel(), rule);
+    RuleTerms terms = CompileRuleTerms(rule);
+    uint64_t births = 0;
+    uint64_t deaths = 0;
+
+    for (size_t ty = tyBegin; ty < tyEnd; ty++) {
+        // Halos are only computed for active tiles, which differ from one tile row to the next
+        size_t activeCount = scratch.FindActiveTiles(src, ty);
+        scratch.ActiveTileCount += activeCount;
+        scratch.Invalidate();
+        std::fill(changed, changed + stride, 0);
+
+        size_t yEnd = std::min(height, (ty + 1) * TileSize);
+        for (size_t y = ty * TileSize; y < yEnd && activeCount > 0; y++) {
+            size_t yAbove = y == 0 ? height - 1 : y - 1;
+            size_t yBelow = y == height - 1 ? 0 : y + 1;
+
+            size_t slotAbove = scratch.FetchRow(src, yAbove, y, yBelow);
+            size_t slotRow = scratch.FetchRow(src, y, yAbove, yBelow);
+            size_t slotBelow = scratch.FetchRow(src, yBelow, yAbove, y);
+
+            StepRowInputs in = {
+                scratch.GetWest(slotAbove), src.GetRow(yAbove), scratch.GetEast(slotAbove),
+                scratch.GetWest(slotRow), src.GetRow(y), scratch.GetEast(slotRow),
+                scratch.GetWest(slotBelow), src.GetRow(yBelow), scratch.GetEast(slotBelow),
+                {}, {},
+            };
+            for (int plane = 0; plane < terms.AgePlanes; plane++) {
+                in.Ages[plane] = src.GetAgeRow(plane, y);
+                in.OutAges[plane] = dst.GetMutAgeRow(plane, y);
+            }
+            CellWord* out = dst.GetMutRow(y);
+
+            // Tiles are one word wide, so word indices double as tile columns
+            for (const TileRun& run : scratch.GetActiveRuns()) {
+                // The last word is masked on its own, its padding bits would otherwise flag a change
+                kernels.StepWords(in, terms, out, changed, run.Begin, std::min(run.End, last));
+                if (run.End > last)
+                    kernels.StepMaskedWord(in, terms, out, changed, last, lastMask);
+
+                // Counted while the words are still in cache. Skipped tiles didn't change, so they add nothing.
+                kernels.CountChanges(in.C, out, run.Begin, run.End, births, deaths);
+            }
+        }
+
+        for (size_t tx = 0; tx < stride; tx++)
+            dst.SetTileChanged(tx, ty, changed[tx] != 0);
+    }
+
+    scratch.Births += births;
+    scratch.Deaths += deaths;
+}
+
+void StepBoard(const BoardState& src, BoardState& dst, StepScratch& scratch, const Rule& rule) {
+    dst.InvalidateDensityPyramid();
+    scratch.Prepare(src);
+    StepTileRows(src, dst, 0, src.GetTileRows(), scratch, rule);
+}
+
+void StepPlaneTiles(PlaneTileStep* tiles, size_t count, const Rule& rule) {
+    static const CellWord emptyTile[TileSize]{};
+    RuleKernels kernels = GetKernels(GetKernelLevel(), rule);
+    RuleTerms terms = CompileRuleTerms(rule);
+
+    // Rows -1 through TileSize of the tile's column, shifted as west and east halos. The kernels
+    // see the tile's rows as the words of a single row, with the rows above and below as its
+    // north and south neighbors.
+    CellWord west[TileSize + 2];
+    CellWord center[TileSize + 2];
+    CellWord east[TileSize + 2];
+    uint8_t changed[TileSize];
+    auto fillHalo = [&](size_t r, CellWord w, CellWord c, CellWord e) {
+        west[r] = (c << 1) | (w >> (CellsPerWord - 1));
+        center[r] = c;
+        east[r] = (c >> 1) | (e << (CellsPerWord - 1));
+    };
+
+    for (size_t t = 0; t < count; t++) {
+        PlaneTileStep& tile = tiles[t];
+        const CellWord* rows[9];
+        for (int i = 0; i < 9; i++)
+            rows[i] = tile.Neighborhood[i] ? tile.Neighborhood[i] : emptyTile;
+
+        fillHalo(0, rows[0][TileSize - 1], rows[1][TileSize - 1], rows[2][TileSize - 1]);
+        for (size_t y = 0; y < TileSize; y++)
+            fillHalo(y + 1, rows[3][y], rows[4][y], rows[5][y]);
+        fillHalo(TileSize + 1, rows[6][0], rows[7][0], rows[8][0]);
+
+        StepRowInputs in = {
+            west, center, east,
+            west + 1, center + 1, east + 1,
+            west + 2, center + 2, east + 2,
+            {}, {},
+        };
+        for (int plane = 0; plane < terms.AgePlanes; plane++) {
+            in.Ages[plane] = tile.Neighborhood[4] + (plane + 1) * TileSize;
+            in.OutAges[plane] = tile.Out + (plane + 1) * TileSize;
+        }
+
+        std::fill(changed, changed + TileSize, 0);
+        kernels.StepWords(in, terms, tile.Out, changed, 0, TileSize);
+        tile.IsChanged = std::find(changed, changed + TileSize, 1) != changed + TileSize;
+    }
+}
+
+void StepBoardReference(const BoardState& src, BoardState& dst, const Rule& rule) {
+    for (int y = 0; y < int(src.GetHeight()); y++) {
+        for (int x = 0; x < int(src.GetWidth()); x++)
+            dst.SetState(x, y, rule.GetNextState(src.GetState(x, y), src.CountNeighbors(x, y)));
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "BoardState.hpp"
+#include "Rule.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// Instruction sets the step kernel can use, in order of preference
+enum class KernelLevel {
+    Scalar,
+    Sse2,
+    Avx2,
+};
+
+// Best kernel the CPU supports, detected with CPUID the first time it's asked for
+KernelLevel GetSupportedKernelLevel();
+
+// Kernel used by StepTileRows. Defaults to the best supported one, and can be lowered
+// to compare implementations; asking for an unsupported one picks the best supported.
+KernelLevel GetKernelLevel();
+void SetKernelLevel(KernelLevel level);
+const char* GetKernelLevelName(KernelLevel level);
+
+// Range [Begin, End) of adjacent tile columns
+struct TileRun {
+    size_t Begin;
+    size_t End;
+};
+
+// Scratch space for the step kernel. Holds west and east shifted copies of the
+// last three rows it was asked for, which act as the halo columns of the torus,
+// so the per-word loop never has to check for wraparound. Also keeps track of
+// which tiles of the tile row being stepped are active.
+class StepScratch {
+public:
+    // Makes sure the buffers fit the board and forgets any cached rows
+    void Prepare(const BoardState& board);
+
+    // Forgets the cached rows
+    void Invalidate();
+
+    // Returns the slot holding the halo of row y, computing it if it isn't cached.
+    // Only the words of active tiles are filled in. The slots holding rows keepA
+    // and keepB are never evicted.
+    size_t FetchRow(const BoardState& board, size_t y, size_t keepA, size_t keepB);
+
+    const CellWord* GetWest(size_t slot) const { return &m_Words[(slot * 2 + 0) * m_Stride]; }
+    const CellWord* GetEast(size_t slot) const { return &m_Words[(slot * 2 + 1) * m_Stride]; }
+
+    // Finds the tiles of a tile row that need to be recomputed, returns how many there are.
+    // Halos computed afterwards only cover those tiles.
+    size_t FindActiveTiles(const BoardState& src, size_t ty);
+    const std::vector<TileRun>& GetActiveRuns() const { return m_Runs; }
+
+    // Per tile column of the tile row being stepped, whether it ended up changing
+    uint8_t* GetChangedTiles() { return m_ChangedTiles.data(); }
+
+    // Number of tiles recomputed since the last Prepare
+    size_t ActiveTileCount{ 0 };
+
+    // Cells that came alive and cells that stopped being alive since the last Prepare.
+    // Under Generations rules, cells that start dying count as deaths.
+    uint64_t Births{ 0 };
+    uint64_t Deaths{ 0 };
+
+private:
+    static constexpr size_t SlotCount = 3;
+    static constexpr size_t NoRow = size_t(-1);
+
+    size_t m_Stride{ 0 };
+    size_t m_Rows[SlotCount]{ NoRow, NoRow, NoRow };
+    std::vector<CellWord, BoardAllocator<CellWord>> m_Words;
+    std::vector<uint8_t, BoardAllocator<uint8_t>> m_ActiveTiles;
+    std::vector<uint8_t, BoardAllocator<uint8_t>> m_ChangedTiles;
+    std::vector<TileRun> m_Runs;
+};
+
+// Steps the tile rows [tyBegin, tyEnd) of src into dst under the given rule, flags the
+// tiles of dst that changed, and adds the births and deaths to the scratch's counts.
+// Both boards must have the same size and the scratch must have been prepared for them,
+// and under Generations rules both need the rule's age planes.
+// Conway's rule and a few other common ones have kernels of their own, any other rule is
+// evaluated from its table.
+//
+// Tiles of src that didn't change, and whose neighbors didn't either, are skipped.
+// Their contents in dst are left alone, so dst has to hold the generation src was
+// stepped from (as the back buffer of a double buffered board does) under the same rule,
+// or src must have all of its tiles flagged as changed. dst's density pyramid is left for
+// the caller to invalidate, since bands of one board are stepped in parallel.
+void StepTileRows(const BoardState& src, BoardState& dst, size_t tyBegin, size_t tyEnd, StepScratch& scratch, const Rule& rule);
+
+// Steps the whole board, with the same requirements as StepTileRows
+void StepBoard(const BoardState& src, BoardState& dst, StepScratch& scratch, const Rule& rule);
+
+// One tile of an unbounded plane, along with the 8 tiles around it in row major order, the tile
+// itself in the middle. Tiles are TileSize rows of one word each, followed by the rule's age
+// planes laid out the same way. Neighbors may be null where the plane is empty.
+struct PlaneTileStep {
+    const CellWord* Neighborhood[9];
+    CellWord* Out;
+    bool IsChanged;
+};
+
+// Steps tiles of an unbounded plane under the given rule, into their Out buffers, which may
+// not overlap any of the inputs. Sets IsChanged if the tile's cells or ages changed. Runs the
+// same kernels as StepTileRows, down a tile's rows rather than along a board's row.
+void StepPlaneTiles(PlaneTileStep* tiles, size_t count, const Rule& rule);
+
+// Cell by cell implementation built on BoardState::CountNeighbors and Rule::GetNextState.
+// Slow, but obviously correct, so it's kept around to check the fast paths against.
+void StepBoardReference(const BoardState& src, BoardState& dst, const Rule& rule);
@@ -0,0 +1,201 @@
+#include "Timeline.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Longest encoding of a word, its gap as a varint and the word itself
+static constexpr size_t MaxEncodedWordBytes = 10 + sizeof(CellWord);
+
+static uint8_t* PutVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = uint8_t(value);
+    return out;
+}
+
+static uint64_t GetVarint(const uint8_t*& in) {
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = *in++;
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+}
+
+// Frames only live in memory, so words are stored in the machine's byte order
+static uint8_t* PutWord(uint8_t* out, CellWord word) {
+    std::memcpy(out, &word, sizeof(CellWord));
+    return out + sizeof(CellWord);
+}
+
+// XORs the frame's words onto the board, which has to be the frame before it (or empty for a keyframe)
+static void ApplyFrame(const std::vector<uint8_t>& data, BoardState& board) {
+    size_t stride = board.GetStride();
+    size_t planeWords = board.GetHeight() * stride;
+    const uint8_t* in = data.data();
+    const uint8_t* end = in + data.size();
+    uint64_t next = 0;
+    while (in < end) {
+        uint64_t index = next + GetVarint(in);
+        CellWord word;
+        std::memcpy(&word, in, sizeof(CellWord));
+        in += sizeof(CellWord);
+        next = index + 1;
+
+        size_t plane = size_t(index / planeWords);
+        size_t y = size_t(index % planeWords) / stride;
+        CellWord* row = plane == 0 ? board.GetMutRow(y) : board.GetMutAgeRow(int(plane) - 1, y);
+        row[index % stride] ^= word;
+    }
+}
+
+void Timeline::Record(const BoardState& board, const BoardState* previous, long long generation) {
+    // After rewinding, or resetting the generation counter, the frames from here on are replaced.
+    // The frame left last isn't the previous generation then.
+    if (!m_Frames.empty() && generation <= m_Frames.back().Generation) {
+        while (!m_Frames.empty() && m_Frames.back().Generation >= generation) {
+            RecycleData(m_Frames.back());
+            m_Frames.pop_back();
+        }
+        m_IsBroken = true;
+    }
+
+    size_t width = board.GetWidth();
+    size_t height = board.GetHeight();
+    int agePlanes = board.GetAgePlaneCount();
+    bool isKeyframe = m_IsBroken || m_IsKeyframeDue || !previous || m_Frames.empty()
+        || generation - m_LastKeyframe >= m_KeyframeInterval
+        || m_Frames.back().Width != width || m_Frames.back().Height != height || m_Frames.back().AgePlanes != agePlanes;
+
+    // Words are visited in the order of their index, cells first and then each age plane. Deltas
+    // only look at the tiles that changed, the others match the previous generation. The scratch
+    // is grown a row at a time, so the words can be written without checking for room.
+    size_t stride = board.GetStride();
+    size_t length = 0;
+    uint64_t next = 0;
+    for (int plane = -1; plane < agePlanes; plane++) {
+        for (size_t ty = 0; ty < board.GetTileRows(); ty++) {
+            m_Columns.clear();
+            for (size_t tx = 0; tx < stride; tx++) {
+                if (isKeyframe || board.IsTileChanged(tx, ty))
+                    m_Columns.push_back(tx);
+            }
+            if (m_Columns.empty())
+                continue;
+
+            size_t yEnd = std::min(height, (ty + 1) * TileSize);
+            for (size_t y = ty * TileSize; y < yEnd; y++) {
+                if (m_Encoded.size() < length + m_Columns.size() * MaxEncodedWordBytes)
+                    m_Encoded.resize(std::max(m_Encoded.size() * 2, length + m_Columns.size() * MaxEncodedWordBytes));
+                uint8_t* out = m_Encoded.data() + length;
+
+                const CellWord* row = plane < 0 ? board.GetRow(y) : board.GetAgeRow(plane, y);
+                const CellWord* before = isKeyframe ? nullptr : plane < 0 ? previous->GetRow(y) : previous->GetAgeRow(plane, y);
+                uint64_t base = (uint64_t(plane + 1) * height + y) * stride;
+                for (size_t tx : m_Columns) {
+                    // Written either way and then dropped if zero, changes are too scattered to branch on
+                    CellWord word = before ? row[tx] ^ before[tx] : row[tx];
+                    uint8_t* start = out;
+                    out = PutWord(PutVarint(out, base + tx - next), word);
+                    bool isKept = word != 0;
+                    out = isKept ? out : start;
+                    next = isKept ? base + tx + 1 : next;
+                }
+                length = out - m_Encoded.data();
+            }
+        }
+    }
+
+    std::vector<uint8_t> data = TakeSpareData(length);
+    data.assign(m_Encoded.begin(), m_Encoded.begin() + length);
+    m_Frames.push_back({ generation, isKeyframe, width, height, agePlanes, std::move(data) });
+    m_Bytes += GetFrameBytes(m_Frames.back());
+    if (isKeyframe) {
+        m_LastKeyframe = generation;
+        m_IsBroken = false;
+        m_IsKeyframeDue = false;
+    }
+
+    // Spare buffers go first. The frames since the last keyframe can't be dropped on their own,
+    // if they're all that's left the next frame starts over with a keyframe, so that they can go
+    // after that.
+    while (GetByteCount() > m_Budget && !m_Frames.empty()) {
+        if (!m_SpareData.empty()) {
+            m_Bytes -= m_SpareData.back().capacity();
+            m_SpareData.pop_back();
+            continue;
+        }
+        auto nextKeyframe = std::find_if(m_Frames.begin() + 1, m_Frames.end(), [](const Frame& frame) { return frame.IsKeyframe; });
+        if (nextKeyframe == m_Frames.end()) {
+            m_IsKeyframeDue = true;
+            break;
+        }
+        DropOldest();
+    }
+}
+
+void Timeline::RecycleData(Frame& frame) {
+    m_Bytes -= sizeof(Frame);
+    m_SpareData.push_back(std::move(frame.Data));
+}
+
+std::vector<uint8_t> Timeline::TakeSpareData(size_t length) {
+    // The smallest spare that fits, unless even that one would waste more than it holds
+    auto best = m_SpareData.end();
+    for (auto spare = m_SpareData.begin(); spare != m_SpareData.end(); ++spare) {
+        if (spare->capacity() >= length && (best == m_SpareData.end() || spare->capacity() < best->capacity()))
+            best = spare;
+    }
+    if (best == m_SpareData.end() || best->capacity() > length * 2 + 4096)
+        return {};
+
+    std::vector<uint8_t> data = std::move(*best);
+    *best = std::move(m_SpareData.back());
+    m_SpareData.pop_back();
+    m_Bytes -= data.capacity();
+    return data;
+}
+
+void Timeline::DropOldest() {
+    do {
+        RecycleData(m_Frames.front());
+        m_Frames.pop_front();
+    } while (!m_Frames.empty() && !m_Frames.front().IsKeyframe);
+}
+
+long long Timeline::Restore(long long generation, BoardState& board) const {
+    // Frames are in order of generation, and the oldest one is always a keyframe
+    auto last = std::upper_bound(m_Frames.begin(), m_Frames.end(), generation,
+        [](long long value, const Frame& frame) { return value < frame.Generation; });
+    if (last == m_Frames.begin())
+        return -1;
+    auto first = last - 1;
+    while (!first->IsKeyframe)
+        --first;
+
+    // The frames are replayed straight into the board, whose storage is reused unless
+    // the keyframe was recorded at another size
+    if (board.GetWidth() != first->Width || board.GetHeight() != first->Height)
+        board = BoardState(first->Width, first->Height);
+    else
+        board.Clear();
+    if (board.GetAgePlaneCount() != first->AgePlanes)
+        board.SetAgePlaneCount(first->AgePlanes);
+    for (auto frame = first; frame != last; ++frame)
+        ApplyFrame(frame->Data, board);
+    board.MarkAllTilesChanged();
+    board.InvalidateDensityPyramid();
+    return (last - 1)->Generation;
+}
+
+void Timeline::Clear() {
+    m_Frames.clear();
+    m_SpareData.clear();
+    m_Encoded = {};
+    m_Columns = {};
+    m_Bytes = 0;
+    m_IsBroken = true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "BoardState.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// History of the board for rewinding. Every so many generations a keyframe holds the whole
+// board, and the frames in between only the difference to the frame before: the XOR of the
+// two generations, of which only the non-zero words are kept, each after the number of zero
+// words before it. Any recorded generation is rebuilt from the keyframe before it.
+//
+// The frames are kept within a memory budget, the oldest keyframes being dropped first,
+// along with the frames that depend on them.
+class Timeline {
+public:
+    // Records the board at the given generation. previous has to hold the generation recorded
+    // last, and the board's tile flags have to cover every difference to it. Without it, or after
+    // Break, a keyframe is recorded. Recording a generation drops any frames from it onwards,
+    // as after rewinding the board no longer leads to them.
+    void Record(const BoardState& board, const BoardState* previous, long long generation);
+
+    // The board no longer follows from the last frame, after edits
+    void Break() { m_IsBroken = true; }
+    bool IsBroken() const { return m_IsBroken; }
+
+    // Rebuilds the last recorded generation at or before the given one into board, replacing it,
+    // and returns its generation. Returns -1 and leaves board alone if there's none.
+    long long Restore(long long generation, BoardState& board) const;
+
+    void Clear();
+
+    // Generations between keyframes. Longer intervals take less memory but make rewinding slower.
+    void SetKeyframeInterval(long long generations) { m_KeyframeInterval = generations; }
+    void SetBudget(size_t bytes) { m_Budget = bytes; }
+
+    bool IsEmpty() const { return m_Frames.empty(); }
+    long long GetOldestGeneration() const { return m_Frames.empty() ? 0 : m_Frames.front().Generation; }
+    long long GetNewestGeneration() const { return m_Frames.empty() ? 0 : m_Frames.back().Generation; }
+    size_t GetFrameCount() const { return m_Frames.size(); }
+    // Includes the spare buffers and the encoding scratch, which count against the budget too
+    size_t GetByteCount() const { return m_Bytes + m_Encoded.capacity() + m_Columns.capacity() * sizeof(size_t); }
+
+private:
+    struct Frame {
+        long long Generation;
+        bool IsKeyframe;
+        size_t Width;
+        size_t Height;
+        int AgePlanes;
+        std::vector<uint8_t> Data;
+    };
+
+    static size_t GetFrameBytes(const Frame& frame) { return sizeof(Frame) + frame.Data.capacity(); }
+    void RecycleData(Frame& frame);
+    std::vector<uint8_t> TakeSpareData(size_t length);
+    void DropOldest();
+
+    std::deque<Frame> m_Frames{};
+    size_t m_Bytes{ 0 };
+    size_t m_Budget{ 64 << 20 };
+    long long m_KeyframeInterval{ 64 };
+    long long m_LastKeyframe{ 0 };
+    bool m_IsBroken{ true };
+    // Set when over budget with nothing but the frames since the last keyframe left
+    bool m_IsKeyframeDue{ false };
+
+    // Frames take as much as the board's changes, up to megabytes each, so the buffers of dropped
+    // frames are kept for reuse rather than having every new frame allocate and fault in its own.
+    // They count against the budget, and are the first to go when it runs out.
+    std::vector<std::vector<uint8_t>> m_SpareData{};
+
+    // Encoding scratch, and the tile columns being encoded
+    std::vector<uint8_t> m_Encoded{};
+    std::vector<size_t> m_Columns{};
+};
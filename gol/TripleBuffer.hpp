@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free single producer, single consumer handoff of the latest value.
+// The producer fills the write slot and publishes it, the consumer picks up
+// whatever was published last. Neither side ever waits for the other, and
+// a slot is never touched by both at once.
+template <typename T>
+class TripleBuffer {
+public:
+    explicit TripleBuffer(const T& initial)
+        : m_Slots{ initial, initial, initial } {}
+
+    // Producer side
+    T& GetWriteSlot() { return m_Slots[m_WriteSlot]; }
+
+    void Publish() {
+        int previous = m_ReadySlot.exchange(m_WriteSlot | FreshFlag);
+        m_WriteSlot = previous & IndexMask;
+    }
+
+    // True once the consumer has picked up the last published value
+    bool IsConsumed() const {
+        return (m_ReadySlot.load() & FreshFlag) == 0;
+    }
+
+    // Consumer side. Returns true if a newer value than the last one was picked up.
+    bool Consume() {
+        if (IsConsumed())
+            return false;
+        int previous = m_ReadySlot.exchange(m_ReadSlot);
+        m_ReadSlot = previous & IndexMask;
+        return true;
+    }
+
+    const T& GetReadSlot() const { return m_Slots[m_ReadSlot]; }
+
+private:
+    static constexpr int IndexMask = 3;
+    static constexpr int FreshFlag = 4;
+
+    T m_Slots[3];
+    int m_WriteSlot{ 0 };
+    std::atomic<int> m_ReadySlot{ 1 };
+    int m_ReadSlot{ 2 };
+};
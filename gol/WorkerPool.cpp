@@ -0,0 +1,70 @@
+#include "WorkerPool.hpp"
+
+void WorkerPool::SetThreadCount(size_t count) {
+    if (count < 1)
+        count = 1;
+    if (count == GetThreadCount())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_IsStopping = true;
+    }
+    m_WakeCondition.notify_all();
+    for (std::thread& worker : m_Workers)
+        worker.join();
+    m_Workers.clear();
+
+    m_IsStopping = false;
+    for (size_t i = 1; i < count; i++)
+        m_Workers.emplace_back(&WorkerPool::WorkerMain, this, i, m_RunCounter);
+}
+
+void WorkerPool::RunErased(size_t jobCount, JobFunction function, void* context) {
+    if (m_Workers.empty() || jobCount <= 1) {
+        RunShare(0, jobCount, function, context);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_JobCount = jobCount;
+        m_Function = function;
+        m_Context = context;
+        m_Pending = m_Workers.size();
+        m_RunCounter++;
+    }
+    m_WakeCondition.notify_all();
+
+    RunShare(0, jobCount, function, context);
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_DoneCondition.wait(lock, [&] { return m_Pending == 0; });
+}
+
+// Participant i takes jobs i, i + n, i + 2n... where n is the thread count
+void WorkerPool::RunShare(size_t participant, size_t jobCount, JobFunction function, void* context) const {
+    for (size_t index = participant; index < jobCount; index += GetThreadCount())
+        function(context, index);
+}
+
+void WorkerPool::WorkerMain(size_t participant, uint64_t lastRun) {
+    while (true) {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_WakeCondition.wait(lock, [&] { return m_IsStopping || m_RunCounter != lastRun; });
+        if (m_IsStopping)
+            return;
+
+        lastRun = m_RunCounter;
+        size_t jobCount = m_JobCount;
+        JobFunction function = m_Function;
+        void* context = m_Context;
+        lock.unlock();
+
+        RunShare(participant, jobCount, function, context);
+
+        lock.lock();
+        if (--m_Pending == 0)
+            m_DoneCondition.notify_one();
+    }
+}
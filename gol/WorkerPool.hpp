@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent set of worker threads. Run hands out jobs to the workers and the
+// calling thread, then waits for all of them to finish, which acts as the barrier
+// between generations. The threads stay alive between runs.
+class WorkerPool {
+public:
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool() { SetThreadCount(1); }
+
+    // Total number of threads doing work, including the one calling Run
+    size_t GetThreadCount() const { return m_Workers.size() + 1; }
+    void SetThreadCount(size_t count);
+
+    // Calls job(index) for every index in [0, jobCount) and returns once all calls are done
+    template <typename Job>
+    void Run(size_t jobCount, Job& job) {
+        RunErased(jobCount, [](void* context, size_t index) { (*static_cast<Job*>(context))(index); }, &job);
+    }
+
+private:
+    typedef void (*JobFunction)(void* context, size_t index);
+
+    void RunErased(size_t jobCount, JobFunction function, void* context);
+    void RunShare(size_t participant, size_t jobCount, JobFunction function, void* context) const;
+    void WorkerMain(size_t participant, uint64_t lastRun);
+
+    std::vector<std::thread> m_Workers;
+    std::mutex m_Mutex;
+    std::condition_variable m_WakeCondition;
+    std::condition_variable m_DoneCondition;
+
+    uint64_t m_RunCounter{ 0 };
+    size_t m_Pending{ 0 };
+    bool m_IsStopping{ false };
+
+    size_t m_JobCount{ 0 };
+    JobFunction m_Function{ nullptr };
+    void* m_Context{ nullptr };
+};
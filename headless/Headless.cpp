@@ -0,0 +1,275 @@
+#include "Checkpoint.hpp"
+#include "GameOfLife.hpp"
+#include "PatternFile.hpp"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+
+// Batch runner without a window. Loads a pattern file (or generates a random soup), runs a fixed number
+// of generations as fast as the engine allows, and reports the timing and population.
+
+struct Options {
+    size_t Width{ 1024 };
+    size_t Height{ 1024 };
+    const char* Pattern{ nullptr };
+    size_t PatternX{ 0 };
+    size_t PatternY{ 0 };
+    float SoupDensity{ 0.35f };
+    unsigned Seed{ 1234 };
+    long long Generations{ 1000 };
+    size_t Threads{ 0 };
+    IterationEngine Engine{ IterationEngine::Board };
+    // Overrides the rule named by the pattern or checkpoint
+    Rule StepRule{};
+    bool HasRule{ false };
+    int HashLifeStepLog2{ 10 };
+    const char* Dump{ nullptr };
+    const char* Resume{ nullptr };
+    const char* Checkpoint{ nullptr };
+    long long CheckpointEvery{ 0 };
+    bool StopOnCycle{ false };
+};
+
+static void PrintUsage() {
+    std::puts(
+        "usage: gol-headless [options]\n"
+        "  --size WxH           board size (default 1024x1024)\n"
+        "  --pattern FILE       pattern to start from instead of a random soup (.rle, .cells or .lif)\n"
+        "  --at X,Y             where the pattern's origin goes (default 0,0)\n"
+        "  --soup DENSITY       live cell density of the random soup (default 0.35)\n"
+        "  --seed N             random soup seed (default 1234)\n"
+        "  --generations N      generations to run (default 1000)\n"
+        "  --threads N          worker threads (default: all hardware threads)\n"
+        "  --engine NAME        board, hashlife or plane (sparse tiles) (default board)\n"
+        "  --step-log2 K        HashLife generations per iteration, as a power of two (default 10)\n"
+        "  --rule B/S           rule in B/S notation, or B/S/C for Generations (default: the pattern's or checkpoint's, else B3/S23)\n"
+        "  --dump FILE          write the final board, in the format matching the file's extension\n"
+        "  --resume FILE        start from a checkpoint, instead of a pattern or soup\n"
+        "  --checkpoint FILE    save a checkpoint at the end of the run\n"
+        "  --checkpoint-every N also save it every N generations, in the background\n"
+        "  --on-cycle ACTION    stop or continue once the board repeats itself (default continue)"
+    );
+}
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (std::strcmp(name, "--help") == 0)
+            return false;
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "missing value for %s\n", name);
+            return false;
+        }
+
+        const char* value = argv[++i];
+        bool valid = true;
+        if (std::strcmp(name, "--size") == 0) {
+            valid = std::sscanf(value, "%zux%zu", &options.Width, &options.Height) == 2
+                && options.Width > 0 && options.Height > 0;
+        } else if (std::strcmp(name, "--pattern") == 0) {
+            options.Pattern = value;
+        } else if (std::strcmp(name, "--at") == 0) {
+            valid = std::sscanf(value, "%zu,%zu", &options.PatternX, &options.PatternY) == 2;
+        } else if (std::strcmp(name, "--soup") == 0) {
+            options.SoupDensity = std::strtof(value, nullptr);
+        } else if (std::strcmp(name, "--seed") == 0) {
+            options.Seed = unsigned(std::strtoul(value, nullptr, 10));
+        } else if (std::strcmp(name, "--generations") == 0) {
+            options.Generations = std::strtoll(value, nullptr, 10);
+            valid = options.Generations >= 0;
+        } else if (std::strcmp(name, "--threads") == 0) {
+            options.Threads = std::strtoul(value, nullptr, 10);
+        } else if (std::strcmp(name, "--engine") == 0) {
+            if (std::strcmp(value, "board") == 0)
+                options.Engine = IterationEngine::Board;
+            else if (std::strcmp(value, "hashlife") == 0)
+                options.Engine = IterationEngine::HashLife;
+            else if (std::strcmp(value, "plane") == 0)
+                options.Engine = IterationEngine::SparsePlane;
+            else
+                valid = false;
+        } else if (std::strcmp(name, "--step-log2") == 0) {
+            options.HashLifeStepLog2 = std::atoi(value);
+        } else if (std::strcmp(name, "--rule") == 0) {
+            std::string error;
+            valid = options.HasRule = Rule::Parse(value, options.StepRule, error);
+            if (!valid)
+                std::fprintf(stderr, "%s\n", error.c_str());
+        } else if (std::strcmp(name, "--dump") == 0) {
+            options.Dump = value;
+        } else if (std::strcmp(name, "--resume") == 0) {
+            options.Resume = value;
+        } else if (std::strcmp(name, "--checkpoint") == 0) {
+            options.Checkpoint = value;
+        } else if (std::strcmp(name, "--checkpoint-every") == 0) {
+            options.CheckpointEvery = std::strtoll(value, nullptr, 10);
+            valid = options.CheckpointEvery > 0;
+        } else if (std::strcmp(name, "--on-cycle") == 0) {
+            options.StopOnCycle = std::strcmp(value, "stop") == 0;
+            valid = options.StopOnCycle || std::strcmp(value, "continue") == 0;
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", name);
+            return false;
+        }
+
+        if (!valid) {
+            std::fprintf(stderr, "invalid value for %s: %s\n", name, value);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Also sets the rule when the pattern file names one
+static bool LoadBoard(const Options& options, BoardState& board, Rule& rule) {
+    if (options.Resume)
+        return true;
+
+    if (!options.Pattern) {
+        std::mt19937 rng(options.Seed);
+        std::bernoulli_distribution alive(options.SoupDensity);
+        for (size_t y = 0; y < board.GetHeight(); y++) {
+            for (size_t x = 0; x < board.GetWidth(); x++)
+                board.SetCellState(int(x), int(y), alive(rng));
+        }
+        return true;
+    }
+
+    std::ifstream file(options.Pattern, std::ios::binary);
+    if (!file) {
+        std::fprintf(stderr, "can't open %s\n", options.Pattern);
+        return false;
+    }
+
+    PatternInfo info;
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    if (!ReadPattern(file, GetPatternFormat(options.Pattern), board, options.PatternX, options.PatternY, info, error)) {
+        std::fprintf(stderr, "%s: %s\n", options.Pattern, error.c_str());
+        return false;
+    }
+    double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::printf("loaded a %zux%zu pattern in %.2f ms\n", info.Width, info.Height, millis);
+
+    if (!info.Rule.empty() && !Rule::Parse(info.Rule, rule, error)) {
+        std::fprintf(stderr, "%s: %s\n", options.Pattern, error.c_str());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 1;
+    }
+
+    // A checkpoint brings its own board size, generation and rule
+    Checkpoint resumed;
+    Rule rule;
+    if (options.Resume) {
+        std::string error;
+        auto start = std::chrono::steady_clock::now();
+        if (!LoadCheckpoint(options.Resume, resumed, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        if (!Rule::Parse(resumed.Rule, rule, error)) {
+            std::fprintf(stderr, "%s: %s\n", options.Resume, error.c_str());
+            return 1;
+        }
+        double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::printf("resumed generation %lld from %s in %.2f ms\n", resumed.Generation, options.Resume, millis);
+        options.Width = resumed.Board.GetWidth();
+        options.Height = resumed.Board.GetHeight();
+    }
+
+    IterationController controller(options.Width, options.Height);
+    if (options.Threads > 0)
+        controller.SetThreadCount(options.Threads);
+    controller.SetEngine(options.Engine);
+    if (options.Resume) {
+        controller.GetMutBoard() = std::move(resumed.Board);
+        controller.SetIterationCounter(resumed.Generation);
+    }
+    if (!LoadBoard(options, controller.GetMutBoard(), rule))
+        return 1;
+    if (options.HasRule)
+        rule = options.StepRule;
+    controller.SetRule(rule);
+
+    uint64_t initialPopulation = controller.GetBoard().CountPopulation();
+    std::printf("%zux%zu board, %" PRIu64 " live cells, %s, %s engine, %zu threads, %s kernel\n",
+        options.Width, options.Height, initialPopulation, rule.ToString().c_str(),
+        options.Engine == IterationEngine::HashLife ? "HashLife" : options.Engine == IterationEngine::SparsePlane ? "sparse plane" : "board",
+        controller.GetThreadCount(), GetKernelLevelName(GetKernelLevel()));
+
+    CheckpointSaver saver;
+    auto saveCheckpoint = [&](long long generation) {
+        saver.Start(options.Checkpoint, Checkpoint{ controller.GetBoard(), generation, rule.ToString() });
+    };
+
+    // HashLife iterations are shrunk towards the end, so the run stops exactly on the requested generation
+    long long firstGeneration = resumed.Generation;
+    long long generations = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (generations < options.Generations) {
+        if (options.Engine == IterationEngine::HashLife) {
+            long long remaining = options.Generations - generations;
+            int stepLog2 = options.HashLifeStepLog2;
+            while (stepLog2 > 0 && (1LL << stepLog2) > remaining)
+                stepLog2--;
+            controller.SetHashLifeStepLog2(stepLog2);
+        }
+
+        long long before = generations;
+        generations += controller.DoIteration();
+        if (options.Checkpoint && options.CheckpointEvery > 0 && generations < options.Generations
+            && generations / options.CheckpointEvery != before / options.CheckpointEvery)
+            saveCheckpoint(firstGeneration + generations);
+        if (options.StopOnCycle && controller.GetCyclePeriod() > 0)
+            break;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // The controller keeps the population up to date as it steps, so it doesn't need counting again
+    GenerationStats stats = controller.GetStats();
+    uint64_t finalPopulation = generations > 0 ? stats.Population : initialPopulation;
+    double cells = double(options.Width) * double(options.Height) * double(generations);
+    std::printf("%lld generations in %.3f s\n", generations, seconds);
+    std::printf("%.1f generations/s, %.4g cells/s\n", generations / seconds, cells / seconds);
+    std::printf("population %" PRIu64 " -> %" PRIu64 ", %" PRIu64 " births and %" PRIu64 " deaths by the last iteration\n",
+        initialPopulation, finalPopulation, stats.Births, stats.Deaths);
+    if (options.Engine == IterationEngine::SparsePlane)
+        std::printf("sparse plane: %zu tiles, %zu bytes\n", controller.GetSparsePlaneTileCount(), controller.GetSparsePlaneBytes());
+    if (controller.GetCyclePeriod() > 0) {
+        // HashLife only sees every 2^k-th generation, so the true period may be a divisor of the one found
+        std::printf("board repeats with period %lld%s from generation %lld\n", controller.GetCyclePeriod(),
+            options.Engine == IterationEngine::HashLife ? " (or a divisor)" : "", controller.GetCycleOnsetGeneration());
+    }
+
+    long long lastGeneration = firstGeneration + generations;
+    if (options.Dump) {
+        std::ofstream file(options.Dump);
+        WritePattern(file, GetPatternFormat(options.Dump), controller.GetBoard(), "generation " + std::to_string(lastGeneration), rule);
+        if (!file) {
+            std::fprintf(stderr, "can't write %s\n", options.Dump);
+            return 1;
+        }
+    }
+
+    if (options.Checkpoint) {
+        saveCheckpoint(lastGeneration);
+        saver.Wait();
+        std::printf("%s\n", saver.GetStatus().c_str());
+    }
+
+    return 0;
+}